@@ -0,0 +1,192 @@
+#pragma once
+
+#include "lt/retry/retry-policy.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace lt { namespace retry {
+
+// Retry budget in which each retry spends tokens in proportion to its cost
+// (bytes sent, estimated CPU milliseconds, ...) and each success refills
+// tokens in proportion to its cost, so a few very large requests cannot use
+// up the headroom a backend needs to recover.
+//
+// ```
+//    // Allow retries worth up to 10% of successfully transferred bytes,
+//    // with a burst allowance of 64 MB
+//    auto budget = std::make_shared<CostBudget>(64e6, 0.1);
+//
+//    auto policy = limitByCost(budget, request.size(), fullJitterBackoff(10ms));
+//    ...
+//    budget->recordSuccess(request.size());
+// ```
+//
+// Tokens are held in a number of cache-line sized shards, each an atomic
+// counter in fixed point. A thread spends from and refills its own shard
+// first, so threads rarely contend; a spend larger than the home shard can
+// cover takes the remainder from the other shards, and puts back whatever
+// it took if the budget as a whole cannot cover it. No locks are taken.
+
+class CostBudget
+{
+   private:
+    // Fixed point units per unit of cost
+    static constexpr double SCALE = 1000.0;
+
+    struct alignas(64) Shard
+    {
+        std::atomic<std::int64_t> tokens{0};
+    };
+
+    std::vector<Shard> shards_;
+    std::int64_t shard_capacity_;
+    double refill_ratio_;
+
+    // Costs are clamped to [0, 2^62] fixed point units, so that converting
+    // them cannot overflow; no real cost comes close to the upper bound
+    static std::int64_t toFixed(double cost)
+    {
+        constexpr std::int64_t MAX_FIXED = std::int64_t(1) << 62;
+
+        if (!(cost > 0.0)) {
+            return 0;
+        }
+
+        if (cost * SCALE >= static_cast<double>(MAX_FIXED)) {
+            return MAX_FIXED;
+        }
+
+        return static_cast<std::int64_t>(cost * SCALE);
+    }
+
+    std::size_t home() const
+    {
+        static thread_local std::size_t hash = std::hash<std::thread::id>()(std::this_thread::get_id());
+        return hash % shards_.size();
+    }
+
+    // Take up to `want` from a shard, returning the amount taken
+    std::int64_t take(Shard& shard, std::int64_t want)
+    {
+        auto current = shard.tokens.load(std::memory_order_relaxed);
+
+        while (current > 0) {
+            auto taken = std::min(current, want);
+
+            if (shard.tokens.compare_exchange_weak(current, current - taken, std::memory_order_acq_rel)) {
+                return taken;
+            }
+        }
+
+        return 0;
+    }
+
+    // Add up to `amount` to a shard without exceeding its capacity,
+    // returning the amount which did not fit
+    std::int64_t give(Shard& shard, std::int64_t amount)
+    {
+        auto current = shard.tokens.load(std::memory_order_relaxed);
+
+        while (current < shard_capacity_) {
+            auto added = std::min(amount, shard_capacity_ - current);
+
+            if (shard.tokens.compare_exchange_weak(current, current + added, std::memory_order_acq_rel)) {
+                return amount - added;
+            }
+        }
+
+        return amount;
+    }
+
+    // Distribute `amount` starting at the home shard; anything beyond the
+    // total capacity is discarded
+    void distribute(std::int64_t amount)
+    {
+        auto start = home();
+
+        for (std::size_t i = 0; i < shards_.size() && amount > 0; i++) {
+            amount = give(shards_[(start + i) % shards_.size()], amount);
+        }
+    }
+
+   public:
+    // `capacity` is the most the budget can hold, in units of cost, and the
+    // budget starts full. Each success refills `refill_ratio` times its
+    // cost.
+    explicit CostBudget(double capacity, double refill_ratio = 0.1, std::size_t shards = 8)
+        : shards_(std::max<std::size_t>(shards, 1)),
+          shard_capacity_(toFixed(capacity) / static_cast<std::int64_t>(shards_.size())),
+          refill_ratio_(refill_ratio)
+    {
+        for (auto& shard : shards_) {
+            shard.tokens.store(shard_capacity_, std::memory_order_relaxed);
+        }
+    }
+
+    CostBudget(const CostBudget&) = delete;
+    CostBudget& operator=(const CostBudget&) = delete;
+
+    // Spend `cost` worth of tokens for a retry. Returns false, spending
+    // nothing, if the budget cannot cover it. The tokens taken towards a
+    // refused spend are put back into whichever shards have room; if
+    // concurrent refills have meanwhile filled the whole budget, the excess
+    // is discarded as a refill's would be.
+    bool trySpend(double cost)
+    {
+        auto want = toFixed(cost);
+        auto start = home();
+        std::int64_t taken = 0;
+
+        for (std::size_t i = 0; i < shards_.size() && taken < want; i++) {
+            taken += take(shards_[(start + i) % shards_.size()], want - taken);
+        }
+
+        if (taken < want) {
+            distribute(taken);
+            return false;
+        }
+
+        return true;
+    }
+
+    void recordSuccess(double cost)
+    {
+        distribute(toFixed(cost * refill_ratio_));
+    }
+
+    // Tokens currently available, in units of cost
+    double available() const
+    {
+        std::int64_t total = 0;
+
+        for (const auto& shard : shards_) {
+            total += shard.tokens.load(std::memory_order_relaxed);
+        }
+
+        return static_cast<double>(total) / SCALE;
+    }
+};
+
+//
+// Only retry while the shared budget can cover the cost of the retry.
+//
+inline RetryPolicy limitByCost(std::shared_ptr<CostBudget> budget, double cost, RetryPolicy policy)
+{
+    return RetryPolicy([=](RetryStatus status) -> std::optional<std::chrono::microseconds> {
+        auto delay = policy(status);
+
+        if (delay && !budget->trySpend(cost)) {
+            return std::nullopt;
+        }
+
+        return delay;
+    });
+}
+
+}}  // namespace lt::retry
@@ -0,0 +1,14 @@
+#pragma once
+
+// Define LT_RETRY_SEPARATE_COMPILATION (as the retry-compiled CMake target
+// does for everything that links it) to take the type-erased combinators in
+// policies.h, and newIdempotencyKey(), out of line. They are then defined
+// exactly once, in src/retry.cpp, which also defines LT_RETRY_SOURCE.
+//
+// Without it the library is header-only and everything is inline.
+
+#ifdef LT_RETRY_SEPARATE_COMPILATION
+#define LT_RETRY_DECL
+#else
+#define LT_RETRY_DECL inline
+#endif
@@ -0,0 +1,244 @@
+#pragma once
+
+#include "lt/retry/retry-policy.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace lt { namespace retry {
+
+namespace detail {
+
+inline std::FILE* openForWriting(const std::string& path)
+{
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+
+    if (!file) {
+        throw std::system_error(errno, std::generic_category(), "cannot open " + path);
+    }
+
+    return file;
+}
+
+inline void writeAll(std::FILE* file, const void* data, std::size_t size)
+{
+    if (size > 0 && std::fwrite(data, 1, size, file) != size) {
+        throw std::system_error(errno, std::generic_category(), "simulation export write failed");
+    }
+}
+
+}  // namespace detail
+
+// Streams simulated retry statuses to a columnar binary file which can be
+// memory-mapped directly by analysis tools.
+//
+// The file starts with a 16 byte header: the magic "LTRSIM01", then the
+// format version and the block size in rows, both as uint32. It is followed
+// by blocks of at most `block_rows` rows. Each block is an 8 byte header
+// holding the number of rows as a uint32 (and 4 bytes of padding), then four
+// int64 columns of that many rows each:
+//
+//     trajectory, iteration_number, cumulative_delay_us, previous_delay_us
+//
+// `previous_delay_us` is -1 where the status had no previous delay. All
+// values are in the host's byte order, and every column is 8 byte aligned
+// within the file, so for example numpy can view a block in place:
+//
+//     cols = np.frombuffer(mm, dtype=np.int64, count=4 * rows, offset=off + 8).reshape(4, rows)
+//
+// Rows are buffered column by column and each full block is written with
+// one fwrite per column, straight from the column buffers.
+
+class ColumnarSimulationWriter
+{
+   public:
+    static constexpr std::uint32_t VERSION = 1;
+
+   private:
+    std::FILE* file_;
+    std::size_t block_rows_;
+    std::size_t rows_ = 0;
+
+    std::vector<std::int64_t> trajectory_;
+    std::vector<std::int64_t> iteration_number_;
+    std::vector<std::int64_t> cumulative_delay_;
+    std::vector<std::int64_t> previous_delay_;
+
+    void writeBlock()
+    {
+        if (rows_ == 0) {
+            return;
+        }
+
+        std::uint32_t header[2] = {static_cast<std::uint32_t>(rows_), 0};
+        detail::writeAll(file_, header, sizeof(header));
+
+        for (auto* column : {&trajectory_, &iteration_number_, &cumulative_delay_, &previous_delay_}) {
+            detail::writeAll(file_, column->data(), rows_ * sizeof(std::int64_t));
+        }
+
+        rows_ = 0;
+    }
+
+   public:
+    explicit ColumnarSimulationWriter(const std::string& path, std::size_t block_rows = 65536)
+        : file_(detail::openForWriting(path)),
+          block_rows_(block_rows > 0 ? block_rows : 1),
+          trajectory_(block_rows_),
+          iteration_number_(block_rows_),
+          cumulative_delay_(block_rows_),
+          previous_delay_(block_rows_)
+    {
+        char header[16] = {'L', 'T', 'R', 'S', 'I', 'M', '0', '1'};
+        std::uint32_t fields[2] = {VERSION, static_cast<std::uint32_t>(block_rows_)};
+        std::memcpy(header + 8, fields, sizeof(fields));
+
+        detail::writeAll(file_, header, sizeof(header));
+    }
+
+    ColumnarSimulationWriter(const ColumnarSimulationWriter&) = delete;
+    ColumnarSimulationWriter& operator=(const ColumnarSimulationWriter&) = delete;
+
+    ~ColumnarSimulationWriter()
+    {
+        try {
+            writeBlock();
+        } catch (...) {
+        }
+        std::fclose(file_);
+    }
+
+    void write(std::int64_t trajectory, const RetryStatus& status)
+    {
+        trajectory_[rows_] = trajectory;
+        iteration_number_[rows_] = status.iteration_number;
+        cumulative_delay_[rows_] = status.cumulative_delay.count();
+        previous_delay_[rows_] = status.previous_delay ? status.previous_delay->count() : -1;
+
+        if (++rows_ == block_rows_) {
+            writeBlock();
+        }
+    }
+
+    // Write out any buffered rows as a (possibly short) block
+    void flush()
+    {
+        writeBlock();
+
+        if (std::fflush(file_) != 0) {
+            throw std::system_error(errno, std::generic_category(), "simulation export flush failed");
+        }
+    }
+};
+
+// Streams simulated retry statuses as CSV, with the same columns as
+// ColumnarSimulationWriter. Numbers are formatted with std::to_chars into a
+// fixed buffer which is written out whenever it fills; previous_delay_us is
+// left empty where the status had no previous delay.
+
+class CsvSimulationWriter
+{
+   private:
+    static constexpr std::size_t MAX_ROW = 4 * 21;
+
+    std::FILE* file_;
+    std::vector<char> buffer_;
+    std::size_t used_ = 0;
+
+    void append(std::int64_t value, char terminator)
+    {
+        auto* begin = buffer_.data() + used_;
+        auto result = std::to_chars(begin, buffer_.data() + buffer_.size(), value);
+
+        *result.ptr = terminator;
+        used_ += static_cast<std::size_t>(result.ptr - begin) + 1;
+    }
+
+    void writeBuffer()
+    {
+        detail::writeAll(file_, buffer_.data(), used_);
+        used_ = 0;
+    }
+
+   public:
+    explicit CsvSimulationWriter(const std::string& path, std::size_t buffer_size = 1 << 20)
+        : file_(detail::openForWriting(path)),
+          buffer_(std::max(buffer_size, MAX_ROW))
+    {
+        static const char header[] = "trajectory,iteration_number,cumulative_delay_us,previous_delay_us\n";
+        detail::writeAll(file_, header, sizeof(header) - 1);
+    }
+
+    CsvSimulationWriter(const CsvSimulationWriter&) = delete;
+    CsvSimulationWriter& operator=(const CsvSimulationWriter&) = delete;
+
+    ~CsvSimulationWriter()
+    {
+        try {
+            writeBuffer();
+        } catch (...) {
+        }
+        std::fclose(file_);
+    }
+
+    void write(std::int64_t trajectory, const RetryStatus& status)
+    {
+        if (buffer_.size() - used_ < MAX_ROW) {
+            writeBuffer();
+        }
+
+        append(trajectory, ',');
+        append(status.iteration_number, ',');
+        append(status.cumulative_delay.count(), ',');
+
+        if (status.previous_delay) {
+            append(status.previous_delay->count(), '\n');
+        } else {
+            buffer_[used_++] = '\n';
+        }
+    }
+
+    void flush()
+    {
+        writeBuffer();
+
+        if (std::fflush(file_) != 0) {
+            throw std::system_error(errno, std::generic_category(), "simulation export flush failed");
+        }
+    }
+};
+
+//
+// Simulate `trajectories` independent runs of a policy, each of at most
+// `max_retries` retries, streaming every status straight to `writer`
+// (a ColumnarSimulationWriter or CsvSimulationWriter) without building
+// intermediate vectors.
+//
+template <typename Writer>
+void simulateTo(Writer& writer, const RetryPolicy& policy, std::int64_t trajectories, int max_retries)
+{
+    if (max_retries <= 0) {
+        return;
+    }
+
+    for (std::int64_t t = 0; t < trajectories; t++) {
+        int n = 0;
+
+        for (const auto& status : policy.schedule()) {
+            writer.write(t, status);
+
+            if (++n == max_retries) break;
+        }
+    }
+
+    writer.flush();
+}
+
+}}  // namespace lt::retry
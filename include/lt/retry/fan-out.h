@@ -0,0 +1,217 @@
+#pragma once
+
+#include "lt/retry/budget.h"
+#include "lt/retry/priority.h"
+#include "lt/retry/retry-policy.h"
+#include "lt/retry/scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace lt { namespace retry {
+
+struct FanOutConfig
+{
+    // Actions which may be in progress (executing or backing off) at once
+    std::size_t parallelism = 32;
+
+    // Time allowed for the whole set, from the call to retryAll()
+    std::chrono::microseconds deadline = std::chrono::microseconds::max();
+
+    // Optional budget shared by every action's retries, each of which
+    // spends `retry_cost` from it
+    std::shared_ptr<CostBudget> budget;
+    double retry_cost = 1.0;
+
+    // Scheduler tenant and priority the actions are dispatched under
+    TenantId tenant = 0;
+    RetryPriority priority = RetryPriority::Interactive;
+};
+
+//
+// Run a set of independent retryable actions with bounded parallelism,
+// dispatching every attempt (including the first) through `scheduler`, so
+// actions run on its executor and no thread sleeps through a backoff.
+//
+// Each action has its own RetryStatus and follows `policy`, but all of them
+// share one deadline: a retry is only scheduled if it would start before
+// the deadline, and actions not yet started when it passes are not started
+// at all. With a budget, retries also stop once it cannot cover them.
+//
+// `onResult` is called with each action's index and final result as it
+// completes, from whichever thread completed it; actions which were never
+// attempted (deadline passed, or the scheduler refused them) report
+// std::nullopt. `done` is called once every action has reported.
+//
+// ```
+//    FanOutConfig config;
+//    config.parallelism = 32;
+//    config.deadline = 2s;
+//
+//    retryAll<Response>(scheduler, config, policy, shouldRetry, std::move(calls),
+//                       [&](std::size_t i, std::optional<Response> response) { ... },
+//                       [&]() { finished.set_value(); });
+// ```
+//
+template <typename T>
+void retryAll(
+    RetryScheduler& scheduler,
+    FanOutConfig config,
+    RetryPolicy policy,
+    std::function<bool(RetryStatus, T)> shouldRetry,
+    std::vector<std::function<T(RetryStatus)>> actions,
+    std::function<void(std::size_t, std::optional<T>)> onResult,
+    std::function<void()> done = {})
+{
+    using clock = RetryScheduler::clock;
+
+    struct FanOut
+    {
+        RetryScheduler* scheduler;
+        FanOutConfig config;
+        clock::time_point deadline;
+        RetryPolicy policy;
+        std::function<bool(RetryStatus, T)> shouldRetry;
+        std::vector<std::function<T(RetryStatus)>> actions;
+        std::function<void(std::size_t, std::optional<T>)> onResult;
+        std::function<void()> done;
+
+        std::mutex mutex;
+        std::size_t next = 0;
+        std::size_t active = 0;
+        std::size_t remaining;
+
+        FanOut(
+            RetryScheduler* scheduler_,
+            FanOutConfig config_,
+            clock::time_point deadline_,
+            RetryPolicy policy_,
+            std::function<bool(RetryStatus, T)> shouldRetry_,
+            std::vector<std::function<T(RetryStatus)>> actions_,
+            std::function<void(std::size_t, std::optional<T>)> onResult_,
+            std::function<void()> done_)
+            : scheduler(scheduler_),
+              config(std::move(config_)),
+              deadline(deadline_),
+              policy(std::move(policy_)),
+              shouldRetry(std::move(shouldRetry_)),
+              actions(std::move(actions_)),
+              onResult(std::move(onResult_)),
+              done(std::move(done_)),
+              remaining(actions.size())
+        {
+            config.parallelism = std::max<std::size_t>(config.parallelism, 1);
+        }
+
+        // Report an action's result and release its slot
+        static void settle(const std::shared_ptr<FanOut>& self, std::size_t index, std::optional<T> result)
+        {
+            self->onResult(index, std::move(result));
+
+            bool finished;
+            {
+                std::lock_guard<std::mutex> lock(self->mutex);
+                self->active -= 1;
+                self->remaining -= 1;
+                finished = self->remaining == 0;
+            }
+
+            if (finished && self->done) {
+                self->done();
+            }
+        }
+
+        // Start actions until the parallelism limit is reached
+        static void fill(const std::shared_ptr<FanOut>& self)
+        {
+            while (true) {
+                std::size_t index;
+                {
+                    std::lock_guard<std::mutex> lock(self->mutex);
+
+                    if (self->next == self->actions.size() || self->active >= self->config.parallelism) {
+                        return;
+                    }
+
+                    index = self->next++;
+                    self->active += 1;
+                }
+
+                bool scheduled = clock::now() < self->deadline &&
+                    self->scheduler->schedule(
+                        self->config.tenant, self->config.priority, std::chrono::microseconds(0),
+                        [self, index]() { attempt(self, index, RetryStatus{}); });
+
+                if (!scheduled) {
+                    settle(self, index, std::nullopt);
+                }
+            }
+        }
+
+        static void finish(const std::shared_ptr<FanOut>& self, std::size_t index, T result)
+        {
+            settle(self, index, std::move(result));
+            fill(self);
+        }
+
+        static void attempt(std::shared_ptr<FanOut> self, std::size_t index, RetryStatus status)
+        {
+            auto result = self->actions[index](status);
+
+            if (!self->shouldRetry(status, result)) {
+                return finish(self, index, std::move(result));
+            }
+
+            auto new_status = self->policy.apply(status);
+
+            if (!new_status) {
+                return finish(self, index, std::move(result));
+            }
+
+            auto delay = new_status->previous_delay.value_or(std::chrono::microseconds(0));
+
+            if (clock::now() + delay >= self->deadline) {
+                return finish(self, index, std::move(result));
+            }
+
+            if (self->config.budget && !self->config.budget->trySpend(self->config.retry_cost)) {
+                return finish(self, index, std::move(result));
+            }
+
+            auto next = *new_status;
+
+            if (!self->scheduler->schedule(
+                    self->config.tenant, self->config.priority, delay,
+                    [self, index, next]() { attempt(self, index, next); })) {
+                finish(self, index, std::move(result));
+            }
+        }
+    };
+
+    auto now = clock::now();
+    auto deadline = config.deadline >= std::chrono::duration_cast<std::chrono::microseconds>(clock::time_point::max() - now)
+        ? clock::time_point::max()
+        : now + config.deadline;
+
+    auto fan_out = std::make_shared<FanOut>(
+        &scheduler, std::move(config), deadline, std::move(policy), std::move(shouldRetry),
+        std::move(actions), std::move(onResult), std::move(done));
+
+    if (fan_out->remaining == 0) {
+        if (fan_out->done) {
+            fan_out->done();
+        }
+        return;
+    }
+
+    FanOut::fill(fan_out);
+}
+
+}}  // namespace lt::retry
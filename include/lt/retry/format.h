@@ -0,0 +1,45 @@
+#pragma once
+
+#include "lt/retry/retry-policy.h"
+
+// std::format support for RetryStatus. This is kept out of retry.h so that
+// translation units which don't format statuses don't pay for <format>.
+//
+// ```
+//    auto line = std::format("retrying after {}", status);
+// ```
+
+#if __has_include(<version>)
+#include <version>
+#endif
+
+#if defined(__cpp_lib_format)
+
+#include <algorithm>
+#include <format>
+
+template <>
+struct std::formatter<lt::retry::RetryStatus, char>
+{
+    constexpr auto parse(std::format_parse_context& ctx)
+    {
+        auto it = ctx.begin();
+
+        if (it != ctx.end() && *it != '}') {
+            throw std::format_error("RetryStatus takes no format specification");
+        }
+
+        return it;
+    }
+
+    template <typename FormatContext>
+    auto format(const lt::retry::RetryStatus& status, FormatContext& ctx) const
+    {
+        char buf[lt::retry::RETRY_STATUS_FORMAT_MAX];
+        auto len = lt::retry::formatTo(buf, sizeof(buf), status);
+
+        return std::copy(buf, buf + len, ctx.out());
+    }
+};
+
+#endif
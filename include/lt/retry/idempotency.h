@@ -0,0 +1,254 @@
+#pragma once
+
+#include "lt/retry/config.h"
+#include "lt/retry/retry-policy.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Only newIdempotencyKey()'s definition needs this
+#if !defined(LT_RETRY_SEPARATE_COMPILATION) || defined(LT_RETRY_SOURCE)
+#include <random>
+#endif
+
+namespace lt { namespace retry {
+
+class IdempotentRetryStatus : public RetryStatus
+{
+   public:
+    IdempotentRetryStatus() : RetryStatus(), idempotency_key() {}
+
+    IdempotentRetryStatus(RetryStatus retry_status, std::uint64_t key)
+        : RetryStatus(retry_status), idempotency_key(key)
+    {}
+
+    // Stable for every attempt of one retry session, and never zero
+    std::uint64_t idempotency_key;
+};
+
+//
+// A random, non-zero 64-bit key for a new retry session. Out of line with
+// LT_RETRY_SEPARATE_COMPILATION, as the combinators in policies.h are.
+//
+LT_RETRY_DECL std::uint64_t newIdempotencyKey();
+
+#if !defined(LT_RETRY_SEPARATE_COMPILATION) || defined(LT_RETRY_SOURCE)
+
+LT_RETRY_DECL std::uint64_t newIdempotencyKey()
+{
+    static thread_local std::mt19937_64 generator(std::random_device{}());
+
+    std::uint64_t key;
+    do {
+        key = generator();
+    } while (key == 0);
+
+    return key;
+}
+
+#endif
+
+// Retry an action with a key which identifies the retry session, so that
+// the receiver of a non-idempotent write can recognise a retried duplicate.
+//
+// ```
+//    auto policy = IdempotentRetry(capDelay(1s, fullJitterBackoff(10ms)) + limitRetries(5));
+//
+//    auto action = [&](IdempotentRetryStatus status) -> Result {
+//        request.setHeader("Idempotency-Key", std::to_string(status.idempotency_key));
+//        return send(request);
+//    };
+//
+//    policy.retry<Result>(shouldRetry, action);
+// ```
+
+class IdempotentRetry
+{
+   private:
+    RetryPolicy policy_;
+
+   public:
+    explicit IdempotentRetry(RetryPolicy policy) : policy_(std::move(policy)) {}
+
+    template <typename T>
+    T retry(
+        std::function<bool(IdempotentRetryStatus, T)> shouldRetry,
+        std::function<T(IdempotentRetryStatus)> action,
+        std::uint64_t key = newIdempotencyKey()) const
+    {
+        IdempotentRetryStatus status(RetryStatus{}, key);
+
+        while (true) {
+            auto result = action(status);
+
+            if (!shouldRetry(status, result)) {
+                return result;
+            }
+
+            auto new_status = policy_.applyAndDelay(status);
+
+            if (!new_status) {
+                return result;
+            }
+
+            status = IdempotentRetryStatus(*new_status, key);
+        }
+    }
+};
+
+// Bounded record of completed idempotency keys, for detecting retried
+// duplicates at the receiver (or at a client replaying writes).
+//
+// Keys are stored in a flat table of atomic 64-bit words, eight bytes per
+// key, with no locks. Each key may live in one of a short run of slots
+// starting at its hash; once a run is full, a slot in it chosen by the new
+// key's hash is overwritten whatever the age of the key it holds. The cache
+// therefore holds at most `capacity` keys but may forget a recent key
+// before an old one. Size it well beyond the number of keys completed
+// within the longest window in which a duplicate can arrive, so that runs
+// are rarely full.
+//
+// An optional bloom prefilter answers most lookups for keys which were
+// never recorded from a small bit array. Bits are never cleared, so it
+// should be sized for the number of distinct keys expected over the life of
+// the cache; once saturated it simply stops filtering.
+//
+// Key 0 is reserved to mark empty slots and is never reported as seen.
+
+class IdempotencyCache
+{
+   private:
+    static constexpr std::size_t PROBE_LENGTH = 8;
+
+    std::vector<std::atomic<std::uint64_t>> slots_;
+    std::vector<std::atomic<std::uint64_t>> bloom_;
+    std::size_t mask_;
+
+    static std::uint64_t mix(std::uint64_t x)
+    {
+        // splitmix64 finaliser
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ull;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebull;
+        x ^= x >> 31;
+        return x;
+    }
+
+    static std::size_t roundUpPow2(std::size_t n)
+    {
+        std::size_t p = 1;
+        while (p < n) p <<= 1;
+        return p;
+    }
+
+    bool bloomMayContain(std::uint64_t h) const
+    {
+        if (bloom_.empty()) return true;
+
+        auto bits = bloom_.size() * 64;
+        auto a = (h & 0xffffffffu) % bits;
+        auto b = (h >> 32) % bits;
+
+        return (bloom_[a / 64].load(std::memory_order_relaxed) & (1ull << (a % 64))) &&
+               (bloom_[b / 64].load(std::memory_order_relaxed) & (1ull << (b % 64)));
+    }
+
+    void bloomAdd(std::uint64_t h)
+    {
+        if (bloom_.empty()) return;
+
+        auto bits = bloom_.size() * 64;
+        auto a = (h & 0xffffffffu) % bits;
+        auto b = (h >> 32) % bits;
+
+        bloom_[a / 64].fetch_or(1ull << (a % 64), std::memory_order_relaxed);
+        bloom_[b / 64].fetch_or(1ull << (b % 64), std::memory_order_relaxed);
+    }
+
+   public:
+    explicit IdempotencyCache(std::size_t capacity, std::size_t bloom_bits = 0)
+        : slots_(roundUpPow2(std::max(capacity, PROBE_LENGTH))),
+          bloom_((bloom_bits + 63) / 64),
+          mask_(slots_.size() - 1)
+    {
+    }
+
+    IdempotencyCache(const IdempotencyCache&) = delete;
+    IdempotencyCache& operator=(const IdempotencyCache&) = delete;
+
+    bool contains(std::uint64_t key) const
+    {
+        if (key == 0) return false;
+
+        auto h = mix(key);
+
+        if (!bloomMayContain(h)) {
+            return false;
+        }
+
+        for (std::size_t i = 0; i < PROBE_LENGTH; i++) {
+            if (slots_[(h + i) & mask_].load(std::memory_order_acquire) == key) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Record `key` as completed. Returns true if it was new, false if it was
+    // already recorded, ie. this is a duplicate.
+    //
+    // Concurrent inserts of the same key probe the same slots in the same
+    // order and, when the run is full, contend for the same victim slot, so
+    // normally only one of them reports it as new. If an insert of another
+    // key overwrites the victim in between, a later duplicate no longer
+    // finds the key and is reported as new as well; like any eviction, this
+    // only happens when the run is full.
+    bool insert(std::uint64_t key)
+    {
+        if (key == 0) return true;
+
+        auto h = mix(key);
+
+        bloomAdd(h);
+
+        for (std::size_t i = 0; i < PROBE_LENGTH; i++) {
+            auto& slot = slots_[(h + i) & mask_];
+            auto current = slot.load(std::memory_order_acquire);
+
+            if (current == key) {
+                return false;
+            }
+
+            if (current == 0) {
+                if (slot.compare_exchange_strong(current, key, std::memory_order_acq_rel)) {
+                    return true;
+                }
+
+                if (current == key) {
+                    return false;
+                }
+            }
+        }
+
+        // Run full: evict a pseudo-randomly chosen key from it
+        auto& victim = slots_[(h + (h >> 59) % PROBE_LENGTH) & mask_];
+        auto current = victim.load(std::memory_order_acquire);
+
+        while (current != key) {
+            if (victim.compare_exchange_weak(current, key, std::memory_order_acq_rel)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    std::size_t capacity() const { return slots_.size(); }
+};
+
+}}  // namespace lt::retry
@@ -0,0 +1,183 @@
+#pragma once
+
+#include "lt/retry/retry-policy.h"
+
+#include <charconv>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace lt { namespace retry {
+
+// How many times the current piece of work may have been repeated by the
+// retry layers above it. Three nested layers of limitRetries(3) can each
+// make four attempts, so the innermost action may run 4 * 4 * 4 = 64 times
+// for one request at the top; `amplification` is that product so far.
+struct AttemptLineage
+{
+    // Number of retry layers
+    int depth = 0;
+
+    // Product of the (1-based) attempt numbers of every layer
+    std::uint64_t amplification = 1;
+
+    // Compact form for forwarding in a request header: "<depth>;<amplification>"
+    std::string toHeader() const
+    {
+        return std::to_string(depth) + ";" + std::to_string(amplification);
+    }
+
+    static std::optional<AttemptLineage> fromHeader(std::string_view value)
+    {
+        AttemptLineage lineage;
+
+        auto sep = value.find(';');
+        if (sep == std::string_view::npos) {
+            return std::nullopt;
+        }
+
+        auto depth = std::from_chars(value.data(), value.data() + sep, lineage.depth);
+        auto amp = std::from_chars(value.data() + sep + 1, value.data() + value.size(), lineage.amplification);
+
+        if (depth.ec != std::errc() || depth.ptr != value.data() + sep ||
+            amp.ec != std::errc() || amp.ptr != value.data() + value.size() ||
+            lineage.depth < 0 || lineage.amplification == 0) {
+            return std::nullopt;
+        }
+
+        return lineage;
+    }
+
+    // The lineage of the calling thread
+    static AttemptLineage current();
+};
+
+namespace detail {
+
+struct LineageState
+{
+    AttemptLineage lineage;
+
+    // Amplification of the layers enclosing the innermost one
+    std::uint64_t above = 1;
+};
+
+inline LineageState& lineageState()
+{
+    static thread_local LineageState state;
+    return state;
+}
+
+inline std::uint64_t saturatingMultiply(std::uint64_t x, std::uint64_t y)
+{
+    if (y != 0 && x > std::numeric_limits<std::uint64_t>::max() / y) {
+        return std::numeric_limits<std::uint64_t>::max();
+    }
+    return x * y;
+}
+
+}  // namespace detail
+
+inline AttemptLineage AttemptLineage::current()
+{
+    return detail::lineageState().lineage;
+}
+
+// Scope of one retry layer on the calling thread. While it is alive,
+// AttemptLineage::current() includes this layer, so retry layers nested
+// inside its action see the cumulative amplification above them.
+//
+// A scope can also adopt a lineage received from elsewhere, eg. parsed
+// from an incoming request header or captured before handing work to
+// another thread, without adding a layer of its own.
+//
+// Scopes must be destroyed in the reverse order of their creation.
+
+class LineageScope
+{
+   private:
+    detail::LineageState saved_;
+
+   public:
+    LineageScope() : saved_(detail::lineageState())
+    {
+        auto& state = detail::lineageState();
+
+        state.above = saved_.lineage.amplification;
+        state.lineage.depth = saved_.lineage.depth + 1;
+        state.lineage.amplification = state.above;
+    }
+
+    explicit LineageScope(AttemptLineage adopted) : saved_(detail::lineageState())
+    {
+        auto& state = detail::lineageState();
+
+        state.lineage = adopted;
+        state.above = adopted.amplification;
+    }
+
+    LineageScope(const LineageScope&) = delete;
+    LineageScope& operator=(const LineageScope&) = delete;
+
+    ~LineageScope()
+    {
+        detail::lineageState() = saved_;
+    }
+
+    // Record that this layer is making the attempt following `status`
+    void attempt(const RetryStatus& status)
+    {
+        auto& state = detail::lineageState();
+
+        state.lineage.amplification = detail::saturatingMultiply(
+            state.above, static_cast<std::uint64_t>(status.iteration_number) + 1);
+    }
+};
+
+//
+// Refuse a retry which would take the amplification, counting every
+// enclosing retry layer, beyond `ceiling`. Used by the
+// innermost layer of `retryWithLineage` calls (or any code holding a
+// LineageScope), so that nested layers cannot multiply into a storm:
+//
+//     auto policy = limitAmplification(16, exponentialBackoff(10ms) + limitRetries(3));
+//
+// The ceiling applies to the product along the current path of nested
+// attempts, which is what can be forwarded between processes; attempts
+// made by sibling calls at the same depth are not added together.
+//
+inline RetryPolicy limitAmplification(std::uint64_t ceiling, RetryPolicy policy)
+{
+    return RetryPolicy([=](RetryStatus status) -> std::optional<std::chrono::microseconds> {
+        auto next = detail::saturatingMultiply(
+            detail::lineageState().above, static_cast<std::uint64_t>(status.iteration_number) + 2);
+
+        if (next > ceiling) {
+            return std::nullopt;
+        }
+
+        return policy(status);
+    });
+}
+
+//
+// As RetryPolicy::retry(), but within a LineageScope, so that the action
+// (and any retry layers it calls) can see and forward the lineage.
+//
+template <typename T>
+T retryWithLineage(
+    const RetryPolicy& policy,
+    std::function<bool(RetryStatus, T)> shouldRetry,
+    std::function<T(RetryStatus)> action)
+{
+    LineageScope scope;
+
+    return policy.retry<T>(shouldRetry, [&](RetryStatus status) -> T {
+        scope.attempt(status);
+        return action(status);
+    });
+}
+
+}}  // namespace lt::retry
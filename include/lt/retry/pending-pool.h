@@ -0,0 +1,152 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+
+namespace lt { namespace retry {
+
+// Why a retry was not scheduled
+enum class RetryRejection
+{
+    None,
+
+    // The tenant already had `max_pending` retries waiting
+    TenantLimit,
+
+    // The tenant's retry budget could not cover the retry's cost
+    TenantBudget,
+
+    // The retry's priority had used its share of the in-flight limit
+    PriorityShed,
+
+    // The pending-retry pool held `capacity` retries
+    PoolCapacity,
+
+    // The pending-retry pool held `memory_limit` bytes
+    PoolMemory,
+};
+
+namespace detail {
+
+inline RetryRejection& lastRejection()
+{
+    static thread_local RetryRejection rejection = RetryRejection::None;
+    return rejection;
+}
+
+}  // namespace detail
+
+//
+// The reason the most recent asynchronous retry session to finish on this
+// thread gave up without retrying, or RetryRejection::None if it finished
+// for any other reason. Intended to be read from within a session's `done`
+// callback, like errno.
+//
+inline RetryRejection lastRetryRejection()
+{
+    return detail::lastRejection();
+}
+
+// Admission control for retries waiting in an asynchronous retry layer,
+// bounding both their number and the memory they hold so that an outage
+// cannot queue retries until the process runs out of memory.
+//
+// A retry acquires its slot when it is scheduled and releases it when it
+// is dispatched (or dropped). Once either limit is reached, new retries are
+// rejected immediately with a reason saying which. Acquiring and releasing
+// are a few atomic operations. An acquire adds itself to the counts first
+// and rolls back if that takes them past a limit, so admitted retries never
+// exceed either limit; a concurrent acquire which sees another's count
+// before it is rolled back may be refused as well, so the pool errs on the
+// side of rejecting.
+//
+// ```
+//    auto pool = std::make_shared<PendingRetryPool>(100000, 256 << 20);
+//    RetryScheduler scheduler(executor, 64, {}, pool);
+//
+//    if (pool->pressure() > 0.8) {
+//        shedLoad();
+//    }
+// ```
+
+class PendingRetryPool
+{
+   private:
+    std::size_t capacity_;
+    std::size_t memory_limit_;
+
+    std::atomic<std::size_t> pending_{0};
+    std::atomic<std::size_t> bytes_{0};
+    std::atomic<std::uint64_t> rejected_capacity_{0};
+    std::atomic<std::uint64_t> rejected_memory_{0};
+
+   public:
+    explicit PendingRetryPool(
+        std::size_t capacity,
+        std::size_t memory_limit = std::numeric_limits<std::size_t>::max())
+        : capacity_(capacity),
+          memory_limit_(memory_limit)
+    {
+    }
+
+    PendingRetryPool(const PendingRetryPool&) = delete;
+    PendingRetryPool& operator=(const PendingRetryPool&) = delete;
+
+    // Admit a pending retry holding `bytes`, or say why not
+    RetryRejection tryAcquire(std::size_t bytes)
+    {
+        if (pending_.fetch_add(1, std::memory_order_relaxed) >= capacity_) {
+            pending_.fetch_sub(1, std::memory_order_relaxed);
+            rejected_capacity_.fetch_add(1, std::memory_order_relaxed);
+            return RetryRejection::PoolCapacity;
+        }
+
+        auto held = bytes_.fetch_add(bytes, std::memory_order_relaxed);
+
+        if (held + bytes > memory_limit_ || held + bytes < held) {
+            bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+            pending_.fetch_sub(1, std::memory_order_relaxed);
+            rejected_memory_.fetch_add(1, std::memory_order_relaxed);
+            return RetryRejection::PoolMemory;
+        }
+
+        return RetryRejection::None;
+    }
+
+    void release(std::size_t bytes)
+    {
+        bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+        pending_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    std::size_t pending() const { return pending_.load(std::memory_order_relaxed); }
+
+    std::size_t bytes() const { return bytes_.load(std::memory_order_relaxed); }
+
+    // How full the pool is, from 0 (empty) to 1 (rejecting): the larger of
+    // the fractions of its capacity and of its memory limit in use
+    double pressure() const
+    {
+        auto count = capacity_ == 0 ? 1.0 : static_cast<double>(pending()) / static_cast<double>(capacity_);
+        auto memory = memory_limit_ == 0 ? 1.0 : static_cast<double>(bytes()) / static_cast<double>(memory_limit_);
+
+        return std::min(std::max(count, memory), 1.0);
+    }
+
+    // Retries rejected for each reason since the pool was created
+    std::uint64_t rejected(RetryRejection reason) const
+    {
+        switch (reason) {
+            case RetryRejection::PoolCapacity:
+                return rejected_capacity_.load(std::memory_order_relaxed);
+            case RetryRejection::PoolMemory:
+                return rejected_memory_.load(std::memory_order_relaxed);
+            default:
+                return 0;
+        }
+    }
+};
+
+}}  // namespace lt::retry
@@ -0,0 +1,506 @@
+#pragma once
+
+#include "lt/retry/retry-policy.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace lt { namespace retry {
+
+#if defined(__unix__) || defined(__APPLE__)
+
+// Per-endpoint backoff state kept in a small memory-mapped file, so that a
+// process which restarts (eg. while crash-looping) resumes backing off from
+// where its predecessor was instead of starting again at iteration 0.
+//
+// The file holds a 64 byte header (the magic "LTRBKF01", the format version
+// and the number of slots, both uint32) followed by a fixed number of 64 byte
+// slots, so its size is bounded. An endpoint's name is hashed to 64 bits and
+// may live in any of WAYS consecutive slots from its home slot; when all of
+// them are taken, the least recently updated entry is evicted.
+//
+// Each slot is a seqlock: its sequence number is odd while a writer is
+// updating it, and readers retry (a bounded number of times) until they see
+// the same even sequence before and after copying the slot, so reads never
+// take a lock. Slots also carry a checksum of their contents. Updates are
+// made in the shared mapping, so they survive the process crashing at any
+// point: a slot left half-written is recognised by its odd sequence or bad
+// checksum and treated as empty. sync() additionally flushes the file to
+// disk, for state which should survive the host going down.
+//
+// Entries older than `max_age` are ignored, so a process started long after
+// an outage does not resume a stale backoff.
+//
+// Every process sharing the file must use the same number of slots; opening
+// a file with a different layout throws rather than discarding its state.
+// Each process holds a shared flock() on the file while it has it open. The
+// first to open it takes the lock exclusively to create or check the file
+// and to clear slots left mid-update by a crashed writer; processes opening
+// it while others have it open leave the slots alone, as an odd sequence
+// may then belong to a live writer.
+
+class BackoffStateFile
+{
+   public:
+    static constexpr std::uint32_t VERSION = 1;
+    static constexpr std::size_t WAYS = 8;
+
+   private:
+    struct alignas(64) Slot
+    {
+        std::atomic<std::uint64_t> sequence;
+        std::atomic<std::uint64_t> key;
+        std::atomic<std::int64_t> iteration;
+        std::atomic<std::int64_t> cumulative_us;
+        std::atomic<std::int64_t> previous_us;
+        std::atomic<std::int64_t> resume_at_us;
+        std::atomic<std::int64_t> updated_us;
+        std::atomic<std::uint64_t> checksum;
+    };
+
+    struct Header
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t slots;
+        char padding[48];
+    };
+
+    static_assert(sizeof(Slot) == 64, "slots must be one cache line");
+    static_assert(sizeof(Header) == 64, "header must be one cache line");
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "slots are shared between processes");
+
+    // A consistent copy of a slot
+    struct Entry
+    {
+        std::uint64_t key;
+        std::int64_t iteration;
+        std::int64_t cumulative_us;
+        std::int64_t previous_us;
+        std::int64_t resume_at_us;
+        std::int64_t updated_us;
+    };
+
+    int fd_ = -1;
+    void* map_ = nullptr;
+    std::size_t size_ = 0;
+    std::size_t slots_;
+    std::chrono::microseconds max_age_;
+
+    Slot* slot(std::size_t i) const
+    {
+        return reinterpret_cast<Slot*>(static_cast<char*>(map_) + sizeof(Header)) + i;
+    }
+
+    static std::uint64_t hash(std::string_view endpoint)
+    {
+        // FNV-1a; zero marks an empty slot
+        std::uint64_t h = 0xcbf29ce484222325ULL;
+
+        for (unsigned char c : endpoint) {
+            h = (h ^ c) * 0x100000001b3ULL;
+        }
+
+        return h != 0 ? h : 1;
+    }
+
+    static std::uint64_t checksum(const Entry& e)
+    {
+        std::uint64_t h = 0xcbf29ce484222325ULL;
+
+        for (auto v : {e.key, std::uint64_t(e.iteration), std::uint64_t(e.cumulative_us), std::uint64_t(e.previous_us),
+                       std::uint64_t(e.resume_at_us), std::uint64_t(e.updated_us)}) {
+            h = (h ^ v) * 0x100000001b3ULL;
+            h ^= h >> 29;
+        }
+
+        return h;
+    }
+
+    static std::int64_t nowUs()
+    {
+        // Wall clock time, which unlike steady_clock is meaningful across
+        // process restarts
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::system_clock::now().time_since_epoch())
+            .count();
+    }
+
+    static bool read(const Slot& s, Entry& e)
+    {
+        for (int attempt = 0; attempt < 64; attempt++) {
+            auto before = s.sequence.load(std::memory_order_acquire);
+
+            if (before & 1) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            e.key = s.key.load(std::memory_order_relaxed);
+            e.iteration = s.iteration.load(std::memory_order_relaxed);
+            e.cumulative_us = s.cumulative_us.load(std::memory_order_relaxed);
+            e.previous_us = s.previous_us.load(std::memory_order_relaxed);
+            e.resume_at_us = s.resume_at_us.load(std::memory_order_relaxed);
+            e.updated_us = s.updated_us.load(std::memory_order_relaxed);
+            auto sum = s.checksum.load(std::memory_order_relaxed);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if (s.sequence.load(std::memory_order_relaxed) == before) {
+                return e.key != 0 && sum == checksum(e);
+            }
+        }
+
+        return false;
+    }
+
+    // Take a slot's write lock. Gives up (returning false) if another writer
+    // holds it for too long, as updates are best effort.
+    static bool lock(Slot& s, std::uint64_t& sequence)
+    {
+        sequence = s.sequence.load(std::memory_order_relaxed);
+
+        for (int attempt = 0; attempt < 1024; attempt++) {
+            if (!(sequence & 1) &&
+                s.sequence.compare_exchange_weak(sequence, sequence + 1, std::memory_order_acquire)) {
+                std::atomic_thread_fence(std::memory_order_release);
+                return true;
+            }
+
+            std::this_thread::yield();
+            sequence = s.sequence.load(std::memory_order_relaxed);
+        }
+
+        return false;
+    }
+
+    static void write(Slot& s, std::uint64_t sequence, const Entry& e)
+    {
+        s.key.store(e.key, std::memory_order_relaxed);
+        s.iteration.store(e.iteration, std::memory_order_relaxed);
+        s.cumulative_us.store(e.cumulative_us, std::memory_order_relaxed);
+        s.previous_us.store(e.previous_us, std::memory_order_relaxed);
+        s.resume_at_us.store(e.resume_at_us, std::memory_order_relaxed);
+        s.updated_us.store(e.updated_us, std::memory_order_relaxed);
+        s.checksum.store(checksum(e), std::memory_order_relaxed);
+        s.sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    // The live entry for `key`, if any
+    std::optional<Entry> find(std::uint64_t key) const
+    {
+        auto home = static_cast<std::size_t>(key % slots_);
+        auto oldest = nowUs() - max_age_.count();
+
+        for (std::size_t i = 0; i < WAYS; i++) {
+            Entry e;
+
+            if (read(*slot((home + i) % slots_), e) && e.key == key) {
+                if (e.updated_us < oldest) {
+                    return std::nullopt;
+                }
+                return e;
+            }
+        }
+
+        return std::nullopt;
+    }
+
+    // Lock the slot to hold `key`: its current slot, else an empty or
+    // expired one, else the least recently updated. Slots which are
+    // mid-update, eg. left so by a writer which crashed, are passed over
+    // rather than waited on. Returns nullptr if no slot could be locked.
+    Slot* place(std::uint64_t key, std::uint64_t& sequence) const
+    {
+        auto home = static_cast<std::size_t>(key % slots_);
+        auto oldest = nowUs() - max_age_.count();
+
+        std::array<std::pair<std::int64_t, Slot*>, WAYS> candidates;
+        std::size_t count = 0;
+
+        for (std::size_t i = 0; i < WAYS; i++) {
+            auto* s = slot((home + i) % slots_);
+            Entry e;
+
+            if (!read(*s, e)) {
+                if (s->sequence.load(std::memory_order_relaxed) & 1) {
+                    continue;
+                }
+
+                e.key = 0;
+                e.updated_us = 0;
+            }
+
+            if (e.key == key) {
+                // Another writer updating the same entry is as fresh
+                return lock(*s, sequence) ? s : nullptr;
+            }
+
+            if (e.key == 0 || e.updated_us < oldest) {
+                e.updated_us = std::numeric_limits<std::int64_t>::min();
+            }
+
+            candidates[count++] = {e.updated_us, s};
+        }
+
+        std::sort(candidates.begin(), candidates.begin() + count,
+                  [](const auto& a, const auto& b) { return a.first < b.first; });
+
+        for (std::size_t i = 0; i < count; i++) {
+            if (lock(*candidates[i].second, sequence)) {
+                return candidates[i].second;
+            }
+        }
+
+        return nullptr;
+    }
+
+    void initialise()
+    {
+        std::memset(map_, 0, size_);
+
+        Header header = {{'L', 'T', 'R', 'B', 'K', 'F', '0', '1'}, VERSION, static_cast<std::uint32_t>(slots_), {}};
+        std::memcpy(map_, &header, sizeof(header));
+    }
+
+    // Clear slots left mid-update by a writer which crashed; only safe while
+    // no other process has the file open
+    void recover()
+    {
+        for (std::size_t i = 0; i < slots_; i++) {
+            auto* s = slot(i);
+            auto sequence = s->sequence.load(std::memory_order_relaxed);
+
+            if (sequence & 1) {
+                // write() publishes sequence + 2, so pass the even value
+                // before the crashed writer took the lock
+                write(*s, sequence - 1, Entry{});
+            }
+        }
+    }
+
+   public:
+    explicit BackoffStateFile(
+        const std::string& path,
+        std::size_t slots = 1024,
+        std::chrono::microseconds max_age = std::chrono::minutes(10))
+        : slots_(std::max(slots, WAYS)),
+          max_age_(max_age)
+    {
+        size_ = sizeof(Header) + slots_ * sizeof(Slot);
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+
+        if (fd_ < 0) {
+            throw std::system_error(errno, std::generic_category(), "cannot open " + path);
+        }
+
+        auto fail = [this, &path](int error, const char* what) {
+            if (map_ && map_ != MAP_FAILED) {
+                ::munmap(map_, size_);
+            }
+            ::close(fd_);
+            throw std::system_error(error, std::generic_category(), what + path);
+        };
+
+        // Exclusive only if no other process has the file open
+        bool exclusive = ::flock(fd_, LOCK_EX | LOCK_NB) == 0;
+
+        if (!exclusive && (errno != EWOULDBLOCK || ::flock(fd_, LOCK_SH) != 0)) {
+            fail(errno, "cannot lock ");
+        }
+
+        struct stat st;
+
+        if (::fstat(fd_, &st) != 0) {
+            fail(errno, "cannot stat ");
+        }
+
+        bool empty = st.st_size == 0;
+
+        if (!(exclusive && empty) && static_cast<std::size_t>(st.st_size) != size_) {
+            fail(EINVAL, "backoff state layout differs in ");
+        }
+
+        if (empty && ::ftruncate(fd_, static_cast<off_t>(size_)) != 0) {
+            fail(errno, "cannot resize ");
+        }
+
+        map_ = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+
+        if (map_ == MAP_FAILED) {
+            fail(errno, "cannot map ");
+        }
+
+        Header header;
+        std::memcpy(&header, map_, sizeof(header));
+
+        // A header still zero was left by a process which crashed while
+        // creating the file
+        static const char blank[8] = {};
+
+        if (exclusive && (empty || std::memcmp(header.magic, blank, 8) == 0)) {
+            initialise();
+        } else if (std::memcmp(header.magic, "LTRBKF01", 8) != 0 || header.version != VERSION ||
+                   header.slots != slots_) {
+            fail(EINVAL, "backoff state layout differs in ");
+        } else if (exclusive) {
+            recover();
+        }
+
+        if (exclusive && ::flock(fd_, LOCK_SH) != 0) {
+            fail(errno, "cannot lock ");
+        }
+    }
+
+    BackoffStateFile(const BackoffStateFile&) = delete;
+    BackoffStateFile& operator=(const BackoffStateFile&) = delete;
+
+    ~BackoffStateFile()
+    {
+        ::munmap(map_, size_);
+        ::close(fd_);
+    }
+
+    // The last status stored for `endpoint`, unless it has expired
+    std::optional<RetryStatus> load(std::string_view endpoint) const
+    {
+        auto e = find(hash(endpoint));
+
+        if (!e) {
+            return std::nullopt;
+        }
+
+        std::optional<std::chrono::microseconds> previous;
+
+        if (e->previous_us >= 0) {
+            previous = std::chrono::microseconds(e->previous_us);
+        }
+
+        return RetryStatus{static_cast<int>(e->iteration), std::chrono::microseconds(e->cumulative_us), previous};
+    }
+
+    // Time left before `endpoint`'s stored backoff delay ends, so that a
+    // restarted process can hold off its first attempt too
+    std::chrono::microseconds untilResume(std::string_view endpoint) const
+    {
+        auto e = find(hash(endpoint));
+
+        if (!e) {
+            return std::chrono::microseconds(0);
+        }
+
+        return std::chrono::microseconds(std::max<std::int64_t>(e->resume_at_us - nowUs(), 0));
+    }
+
+    // Record the status a retry session has reached, its previous_delay
+    // being the backoff it is about to wait out
+    void store(std::string_view endpoint, const RetryStatus& status)
+    {
+        auto key = hash(endpoint);
+        auto now = nowUs();
+        auto previous = status.previous_delay ? status.previous_delay->count() : -1;
+
+        std::uint64_t sequence;
+
+        if (auto* s = place(key, sequence)) {
+            write(*s, sequence, Entry{
+                key, status.iteration_number, status.cumulative_delay.count(), previous,
+                now + std::max<std::int64_t>(previous, 0), now});
+        }
+    }
+
+    // Forget `endpoint`'s state, eg. once a request to it has succeeded
+    void reset(std::string_view endpoint)
+    {
+        auto key = hash(endpoint);
+        auto home = static_cast<std::size_t>(key % slots_);
+
+        for (std::size_t i = 0; i < WAYS; i++) {
+            auto& s = *slot((home + i) % slots_);
+            Entry e;
+            std::uint64_t sequence;
+
+            if (read(s, e) && e.key == key && lock(s, sequence)) {
+                write(s, sequence, Entry{});
+            }
+        }
+    }
+
+    // Flush the file to disk
+    void sync()
+    {
+        if (::msync(map_, size_, MS_SYNC) != 0) {
+            throw std::system_error(errno, std::generic_category(), "backoff state sync failed");
+        }
+    }
+};
+
+//
+// Resume `endpoint`'s backoff from the state in `file`, and keep that state
+// up to date as the policy backs off. Each decision continues from
+// whichever is further along, the session's own status or the stored one,
+// so a new process (or session) picks up the backoff level where the last
+// one left it. Call `file->reset(endpoint)` once a request succeeds.
+//
+// The policy only spaces out retries; a new process's first attempt is not
+// delayed by it. Call awaitResume() before that attempt so that a
+// crash-looping service does not hit the endpoint on every restart:
+//
+//     auto file = std::make_shared<BackoffStateFile>(path);
+//     auto policy = persistBackoff(file, "db", fullJitterBackoff(10ms));
+//
+//     awaitResume(*file, "db");
+//     policy.retry<Result>(shouldRetry, action);
+//
+inline RetryPolicy persistBackoff(std::shared_ptr<BackoffStateFile> file, std::string endpoint, RetryPolicy policy)
+{
+    return RetryPolicy([=](RetryStatus status) -> std::optional<std::chrono::microseconds> {
+        auto stored = file->load(endpoint);
+
+        if (stored && stored->iteration_number > status.iteration_number) {
+            status = *stored;
+        }
+
+        auto delay = policy(status);
+
+        if (delay) {
+            file->store(endpoint, RetryStatus{status.iteration_number + 1, status.cumulative_delay + *delay, delay});
+        }
+
+        return delay;
+    });
+}
+
+//
+// Sleep until the backoff delay last stored for `endpoint` has ended, eg.
+// before a restarted process's first attempt.
+//
+inline void awaitResume(const BackoffStateFile& file, std::string_view endpoint)
+{
+    std::this_thread::sleep_for(file.untilResume(endpoint));
+}
+
+#endif
+
+}}  // namespace lt::retry
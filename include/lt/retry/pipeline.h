@@ -0,0 +1,413 @@
+#pragma once
+
+#include "lt/retry/priority.h"
+#include "lt/retry/retry-policy.h"
+#include "lt/retry/scheduler.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace lt { namespace retry {
+
+struct RetryingStageConfig
+{
+    // Elements waiting to be dispatched
+    std::size_t input_capacity = 1024;
+
+    // Elements finished or in progress which have not yet been popped,
+    // including those held back by the reorder buffer
+    std::size_t output_capacity = 1024;
+
+    // Elements executing at once
+    std::size_t max_active = 64;
+
+    // Elements backing off beyond which push() blocks. These do not count
+    // against `max_active`.
+    std::size_t max_parked = 256;
+
+    // Emit results in input order rather than completion order
+    bool ordered = false;
+
+    // Scheduler tenant and priority the elements are dispatched under
+    TenantId tenant = 0;
+    RetryPriority priority = RetryPriority::Interactive;
+};
+
+// Pipeline stage which processes elements on a RetryScheduler's executor,
+// retrying failed elements under a RetryPolicy without holding up the
+// elements behind them.
+//
+// `process` returns the output for an element, or std::nullopt if the
+// attempt failed. A failed element is parked in the scheduler's timer heap
+// for its backoff and reinjected when due, while the stage carries on
+// dispatching later elements. A parked element gives up its place among
+// the `max_active` executing ones, so throughput under partial failure
+// stays close to the healthy rate. When due, it goes ahead of new inputs
+// for the next free place. Elements the policy gives up on are handed to
+// `failed`, if given, and dropped.
+//
+// Both ends are bounded. push() blocks while the input queue is full or
+// while `max_parked` elements are backing off, so a failing downstream
+// slows the producer instead of growing the stage without limit. Elements
+// are only dispatched while there is room for their output.
+//
+// With `ordered`, outputs pass through a reorder buffer and are popped in
+// the order their inputs were pushed; an element still retrying then holds
+// back the outputs after it, up to `output_capacity`.
+//
+// ```
+//    RetryingStage<Record, Row> stage(scheduler, policy, parse);
+//
+//    producer:  stage.push(record); ... stage.close();
+//    consumer:  while (auto row = stage.pop()) { ... }
+// ```
+
+template <typename In, typename Out>
+class RetryingStage
+{
+   public:
+    using Process = std::function<std::optional<Out>(const In&, RetryStatus)>;
+    using Failed = std::function<void(const In&, RetryStatus)>;
+
+   private:
+    struct Element
+    {
+        In value;
+        std::uint64_t sequence;
+    };
+
+    // An element ready to be attempted
+    struct Work
+    {
+        std::shared_ptr<Element> element;
+        RetryStatus status;
+    };
+
+    struct Slot
+    {
+        bool done = false;
+        std::optional<Out> value;
+    };
+
+    struct State
+    {
+        RetryScheduler* scheduler;
+        RetryPolicy policy;
+        Process process;
+        Failed failed;
+        RetryingStageConfig config;
+
+        std::mutex mutex;
+        std::condition_variable not_full;
+        std::condition_variable not_empty;
+
+        std::deque<In> input;
+        std::deque<Out> output;
+
+        // Parked elements whose backoff has elapsed, waiting for a place
+        std::deque<Work> due;
+
+        // Results from `next_output` onwards, in input order
+        std::deque<Slot> reorder;
+        std::uint64_t next_sequence = 0;
+        std::uint64_t next_output = 0;
+
+        std::size_t active = 0;
+        std::size_t parked = 0;
+        bool closed = false;
+
+        State(RetryScheduler* scheduler_, RetryPolicy policy_, Process process_, Failed failed_, RetryingStageConfig config_)
+            : scheduler(scheduler_),
+              policy(std::move(policy_)),
+              process(std::move(process_)),
+              failed(std::move(failed_)),
+              config(config_)
+        {
+        }
+
+        // Whether a parked element can resume; its output is already
+        // accounted for
+        bool hasRoomToResume() const
+        {
+            return active < config.max_active;
+        }
+
+        bool hasRoom() const
+        {
+            auto held = config.ordered ? reorder.size() : active + parked;
+            return hasRoomToResume() && output.size() + held < config.output_capacity;
+        }
+
+        bool acceptsInput() const
+        {
+            return input.size() < config.input_capacity && parked < config.max_parked;
+        }
+
+        bool drained() const
+        {
+            return closed && input.empty() && active == 0 && parked == 0;
+        }
+
+        // A parked element stops being parked and becomes active; call with
+        // the mutex held
+        void resume()
+        {
+            parked -= 1;
+            active += 1;
+            not_full.notify_all();
+        }
+
+        // Take due elements, then inputs, which can be dispatched now; call
+        // with the mutex held
+        std::vector<Work> take()
+        {
+            std::vector<Work> taken;
+
+            while (!due.empty() && hasRoomToResume()) {
+                taken.push_back(std::move(due.front()));
+                due.pop_front();
+                resume();
+            }
+
+            while (!input.empty() && hasRoom()) {
+                taken.push_back(Work{
+                    std::make_shared<Element>(Element{std::move(input.front()), next_sequence++}),
+                    RetryStatus{}});
+                input.pop_front();
+                active += 1;
+
+                if (config.ordered) {
+                    reorder.emplace_back();
+                }
+            }
+
+            if (!taken.empty()) {
+                not_full.notify_all();
+            }
+
+            return taken;
+        }
+    };
+
+    std::shared_ptr<State> state_;
+
+    static void dispatch(const std::shared_ptr<State>& state, std::vector<Work> taken)
+    {
+        for (auto& work : taken) {
+            auto element = work.element;
+            auto status = work.status;
+            auto task = [state, element, status]() { attempt(state, element, status); };
+
+            if (!state->scheduler->schedule(
+                    state->config.tenant, state->config.priority, std::chrono::microseconds(0), std::move(task))) {
+                giveUp(state, element, status);
+            }
+        }
+    }
+
+    static void giveUp(const std::shared_ptr<State>& state, const std::shared_ptr<Element>& element, RetryStatus status)
+    {
+        if (state->failed) {
+            state->failed(element->value, status);
+        }
+
+        finish(state, *element, std::nullopt);
+    }
+
+    static void finish(const std::shared_ptr<State>& state, const Element& element, std::optional<Out> result)
+    {
+        std::vector<Work> taken;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->active -= 1;
+
+            if (state->config.ordered) {
+                auto& slot = state->reorder[element.sequence - state->next_output];
+                slot.done = true;
+                slot.value = std::move(result);
+
+                while (!state->reorder.empty() && state->reorder.front().done) {
+                    if (state->reorder.front().value) {
+                        state->output.push_back(std::move(*state->reorder.front().value));
+                    }
+                    state->reorder.pop_front();
+                    state->next_output += 1;
+                }
+            } else if (result) {
+                state->output.push_back(std::move(*result));
+            }
+
+            taken = state->take();
+            state->not_empty.notify_all();
+        }
+
+        dispatch(state, std::move(taken));
+    }
+
+    // A parked element's backoff has elapsed
+    static void wake(const std::shared_ptr<State>& state, const std::shared_ptr<Element>& element, RetryStatus status)
+    {
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+
+            if (!state->hasRoomToResume()) {
+                state->due.push_back(Work{element, status});
+                return;
+            }
+
+            state->resume();
+        }
+
+        attempt(state, element, status);
+    }
+
+    static void attempt(const std::shared_ptr<State>& state, const std::shared_ptr<Element>& element, RetryStatus status)
+    {
+        auto result = state->process(element->value, status);
+
+        if (result) {
+            return finish(state, *element, std::move(result));
+        }
+
+        auto new_status = state->policy.apply(status);
+
+        if (!new_status) {
+            return giveUp(state, element, status);
+        }
+
+        // Park the element, freeing its place for the next one
+        std::vector<Work> taken;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->active -= 1;
+            state->parked += 1;
+            taken = state->take();
+        }
+
+        dispatch(state, std::move(taken));
+
+        auto delay = new_status->previous_delay.value_or(std::chrono::microseconds(0));
+        auto next = *new_status;
+        auto task = [state, element, next]() { wake(state, element, next); };
+
+        if (!state->scheduler->schedule(state->config.tenant, state->config.priority, delay, std::move(task))) {
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->resume();
+            }
+
+            giveUp(state, element, status);
+        }
+    }
+
+   public:
+    explicit RetryingStage(
+        RetryScheduler& scheduler,
+        RetryPolicy policy,
+        Process process,
+        RetryingStageConfig config = {},
+        Failed failed = {})
+        : state_(std::make_shared<State>(&scheduler, std::move(policy), std::move(process), std::move(failed), config))
+    {
+    }
+
+    RetryingStage(const RetryingStage&) = delete;
+    RetryingStage& operator=(const RetryingStage&) = delete;
+
+    // Add an element, blocking while the stage is full or too many elements
+    // are backing off. Returns false if the stage has been closed.
+    bool push(In value)
+    {
+        std::vector<Work> taken;
+        {
+            std::unique_lock<std::mutex> lock(state_->mutex);
+            state_->not_full.wait(lock, [this]() { return state_->closed || state_->acceptsInput(); });
+
+            if (state_->closed) {
+                return false;
+            }
+
+            state_->input.push_back(std::move(value));
+            taken = state_->take();
+        }
+
+        dispatch(state_, std::move(taken));
+        return true;
+    }
+
+    // As push(), but returns false instead of blocking
+    bool tryPush(In value)
+    {
+        std::vector<Work> taken;
+        {
+            std::lock_guard<std::mutex> lock(state_->mutex);
+
+            if (state_->closed || !state_->acceptsInput()) {
+                return false;
+            }
+
+            state_->input.push_back(std::move(value));
+            taken = state_->take();
+        }
+
+        dispatch(state_, std::move(taken));
+        return true;
+    }
+
+    // Take the next output, blocking until one is available. Returns
+    // std::nullopt once the stage is closed and every element has finished.
+    std::optional<Out> pop()
+    {
+        std::optional<Out> result;
+        std::vector<Work> taken;
+        {
+            std::unique_lock<std::mutex> lock(state_->mutex);
+            state_->not_empty.wait(lock, [this]() { return !state_->output.empty() || state_->drained(); });
+
+            if (state_->output.empty()) {
+                return std::nullopt;
+            }
+
+            result = std::move(state_->output.front());
+            state_->output.pop_front();
+            taken = state_->take();
+        }
+
+        dispatch(state_, std::move(taken));
+        return result;
+    }
+
+    // No more elements will be pushed; blocked producers are released
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(state_->mutex);
+            state_->closed = true;
+        }
+        state_->not_full.notify_all();
+        state_->not_empty.notify_all();
+    }
+
+    // Elements currently backing off
+    std::size_t parked() const
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        return state_->parked;
+    }
+
+    // Elements currently executing
+    std::size_t active() const
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        return state_->active;
+    }
+};
+
+}}  // namespace lt::retry
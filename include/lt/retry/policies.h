@@ -1,16 +1,100 @@
 #pragma once
 
+#include "lt/retry/config.h"
 #include "lt/retry/retry-policy.h"
 
+#include <cstdint>
+#include <string_view>
+
+// Only the definitions need these, so users of the retry-compiled library
+// don't pay for them
+#if !defined(LT_RETRY_SEPARATE_COMPILATION) || defined(LT_RETRY_SOURCE)
 #include <cmath>
 #include <random>
+#endif
 
 namespace lt { namespace retry {
 
+// The combinators are declared up front so that, when built with
+// LT_RETRY_SEPARATE_COMPILATION, users of the retry-compiled library see
+// only these declarations and the definitions below are compiled once into
+// the library. Otherwise they are all inline.
+
+LT_RETRY_DECL std::chrono::microseconds backoffDelay(std::chrono::microseconds base, int iteration_number);
+LT_RETRY_DECL std::chrono::microseconds fullJitterDelay(std::chrono::microseconds max_delay);
+LT_RETRY_DECL std::chrono::microseconds equalJitterDelay(std::chrono::microseconds max_delay);
+LT_RETRY_DECL RetryPolicy neverRetry();
+LT_RETRY_DECL RetryPolicy limitRetries(int retryLimit);
+LT_RETRY_DECL RetryPolicy limitCumulativeDelay(std::chrono::microseconds cumulativeDelayLimit, RetryPolicy policy);
+LT_RETRY_DECL RetryPolicy limitTimePoint(std::chrono::system_clock::time_point time_point_limit, RetryPolicy policy);
+LT_RETRY_DECL RetryPolicy limitRetriesByDelay(std::chrono::microseconds delayLimit, RetryPolicy policy);
+LT_RETRY_DECL RetryPolicy constantDelay(std::chrono::microseconds delay);
+LT_RETRY_DECL RetryPolicy fullJitter(std::chrono::microseconds max_delay);
+LT_RETRY_DECL RetryPolicy equalJitter(std::chrono::microseconds max_delay);
+LT_RETRY_DECL RetryPolicy exponentialBackoff(std::chrono::microseconds base);
+LT_RETRY_DECL RetryPolicy fullJitterBackoff(std::chrono::microseconds base);
+LT_RETRY_DECL RetryPolicy equalJitterBackoff(std::chrono::microseconds base);
+LT_RETRY_DECL RetryPolicy decorrelatedJitterBackoff(std::chrono::microseconds base);
+LT_RETRY_DECL RetryPolicy capDelay(std::chrono::microseconds maxDelay, RetryPolicy policy);
+LT_RETRY_DECL RetryPolicy slottedBackoff(
+    std::chrono::microseconds base, std::chrono::microseconds max_delay, std::uint64_t client_index);
+LT_RETRY_DECL RetryPolicy slottedBackoff(
+    std::chrono::microseconds base, std::chrono::microseconds max_delay, std::string_view client_id);
+
+#if !defined(LT_RETRY_SEPARATE_COMPILATION) || defined(LT_RETRY_SOURCE)
+
+namespace detail {
+
+inline std::mt19937& jitterGenerator()
+{
+    static thread_local std::mt19937 generator;
+    return generator;
+}
+
+inline std::uint64_t reverseBits(std::uint64_t x)
+{
+    x = ((x >> 1) & 0x5555555555555555ull) | ((x & 0x5555555555555555ull) << 1);
+    x = ((x >> 2) & 0x3333333333333333ull) | ((x & 0x3333333333333333ull) << 2);
+    x = ((x >> 4) & 0x0f0f0f0f0f0f0f0full) | ((x & 0x0f0f0f0f0f0f0f0full) << 4);
+    x = ((x >> 8) & 0x00ff00ff00ff00ffull) | ((x & 0x00ff00ff00ff00ffull) << 8);
+    x = ((x >> 16) & 0x0000ffff0000ffffull) | ((x & 0x0000ffff0000ffffull) << 16);
+    return (x >> 32) | (x << 32);
+}
+
+}  // namespace detail
+
+//
+// The uncapped delay of exponential backoff at a given iteration: base * 2^n
+//
+LT_RETRY_DECL std::chrono::microseconds backoffDelay(std::chrono::microseconds base, int iteration_number)
+{
+    return base * static_cast<int>(std::pow(2, iteration_number));
+}
+
+//
+// A delay drawn uniformly from [0, max_delay].
+//
+LT_RETRY_DECL std::chrono::microseconds fullJitterDelay(std::chrono::microseconds max_delay)
+{
+    std::uniform_int_distribution<std::chrono::microseconds::rep> distribution(0, max_delay.count());
+
+    return std::chrono::microseconds(distribution(detail::jitterGenerator()));
+}
+
+//
+// A delay drawn uniformly from [max_delay / 2, max_delay].
+//
+LT_RETRY_DECL std::chrono::microseconds equalJitterDelay(std::chrono::microseconds max_delay)
+{
+    auto half_n = max_delay / 2;
+
+    return half_n + fullJitterDelay(half_n);
+}
+
 //
 // Never retry
 //
-inline RetryPolicy neverRetry()
+LT_RETRY_DECL RetryPolicy neverRetry()
 {
     return RetryPolicy([=](RetryStatus status) -> std::optional<std::chrono::microseconds> { return std::nullopt; });
 }
@@ -18,7 +102,7 @@ inline RetryPolicy neverRetry()
 //
 // Retry immediately, but only up to 'retryLimit' times.
 //
-inline RetryPolicy limitRetries(int retryLimit)
+LT_RETRY_DECL RetryPolicy limitRetries(int retryLimit)
 {
     return RetryPolicy([=](RetryStatus status) -> std::optional<std::chrono::microseconds> {
         if (status.iteration_number >= retryLimit) return std::nullopt;
@@ -30,7 +114,7 @@ inline RetryPolicy limitRetries(int retryLimit)
 //
 // Set a limit on the total time spent retrying
 //
-inline RetryPolicy limitCumulativeDelay(std::chrono::microseconds cumulativeDelayLimit, RetryPolicy policy)
+LT_RETRY_DECL RetryPolicy limitCumulativeDelay(std::chrono::microseconds cumulativeDelayLimit, RetryPolicy policy)
 {
     return RetryPolicy([=](RetryStatus status) -> std::optional<std::chrono::microseconds> {
         auto delay = policy(status);
@@ -47,7 +131,7 @@ inline RetryPolicy limitCumulativeDelay(std::chrono::microseconds cumulativeDela
 // Set an absolute time point beyond which to stop retrying,
 // eg. don't retry after 07:02:00 AM today
 //
-inline RetryPolicy limitTimePoint(std::chrono::system_clock::time_point time_point_limit, RetryPolicy policy)
+LT_RETRY_DECL RetryPolicy limitTimePoint(std::chrono::system_clock::time_point time_point_limit, RetryPolicy policy)
 {
     return RetryPolicy([=](RetryStatus status) -> std::optional<std::chrono::microseconds> {
         auto delay = policy(status);
@@ -64,7 +148,7 @@ inline RetryPolicy limitTimePoint(std::chrono::system_clock::time_point time_poi
 // Set a delay limit on a policy such that once the given delay amount has been
 // reached or exceeded, the policy will stop retrying.
 //
-inline RetryPolicy limitRetriesByDelay(std::chrono::microseconds delayLimit, RetryPolicy policy)
+LT_RETRY_DECL RetryPolicy limitRetriesByDelay(std::chrono::microseconds delayLimit, RetryPolicy policy)
 {
     return RetryPolicy([=](RetryStatus status) -> std::optional<std::chrono::microseconds> {
         auto delay = policy(status);
@@ -80,7 +164,7 @@ inline RetryPolicy limitRetriesByDelay(std::chrono::microseconds delayLimit, Ret
 //
 // Constant delay with unlimited retries.
 //
-inline RetryPolicy constantDelay(std::chrono::microseconds delay)
+LT_RETRY_DECL RetryPolicy constantDelay(std::chrono::microseconds delay)
 {
     return RetryPolicy([=](RetryStatus status) -> std::optional<std::chrono::microseconds> { return delay; });
 }
@@ -88,28 +172,20 @@ inline RetryPolicy constantDelay(std::chrono::microseconds delay)
 //
 // Full jitter delay with unlimited retries.
 //
-inline RetryPolicy fullJitter(std::chrono::microseconds max_delay)
+LT_RETRY_DECL RetryPolicy fullJitter(std::chrono::microseconds max_delay)
 {
     return RetryPolicy([=](RetryStatus status) -> std::optional<std::chrono::microseconds> {
-        static thread_local std::mt19937 generator;
-        std::uniform_int_distribution<int> distribution(0, max_delay.count());
-
-        return std::chrono::microseconds(distribution(generator));
+        return fullJitterDelay(max_delay);
     });
 }
 
 //
 // Equal jitter delay with unlimited retries.
 //
-inline RetryPolicy equalJitter(std::chrono::microseconds max_delay)
+LT_RETRY_DECL RetryPolicy equalJitter(std::chrono::microseconds max_delay)
 {
     return RetryPolicy([=](RetryStatus status) -> std::optional<std::chrono::microseconds> {
-        auto half_n = max_delay / 2;
-
-        static thread_local std::mt19937 generator;
-        std::uniform_int_distribution<int> distribution(0, half_n.count());
-
-        return half_n + std::chrono::microseconds(distribution(generator));
+        return equalJitterDelay(max_delay);
     });
 }
 
@@ -118,10 +194,10 @@ inline RetryPolicy equalJitter(std::chrono::microseconds max_delay)
 // Grow delay exponentially each iteration. Each delay will increase by a
 // factor of two.
 //
-inline RetryPolicy exponentialBackoff(std::chrono::microseconds base)
+LT_RETRY_DECL RetryPolicy exponentialBackoff(std::chrono::microseconds base)
 {
     return RetryPolicy([=](RetryStatus status) -> std::optional<std::chrono::microseconds> {
-        return base * static_cast<int>(std::pow(2, status.iteration_number));
+        return backoffDelay(base, status.iteration_number);
     });
 }
 
@@ -136,15 +212,10 @@ inline RetryPolicy exponentialBackoff(std::chrono::microseconds base)
 //
 //     auto policy = capDelay(1000ms, fullJitterBackoff(10us));
 //
-inline RetryPolicy fullJitterBackoff(std::chrono::microseconds base)
+LT_RETRY_DECL RetryPolicy fullJitterBackoff(std::chrono::microseconds base)
 {
     return RetryPolicy([=](RetryStatus status) -> std::optional<std::chrono::microseconds> {
-        auto n = (base * static_cast<int>(std::pow(2, status.iteration_number)));
-
-        static thread_local std::mt19937 generator;
-        std::uniform_int_distribution<int> distribution(0, n.count());
-
-        return std::chrono::microseconds(distribution(generator));
+        return fullJitterDelay(backoffDelay(base, status.iteration_number));
     });
 }
 
@@ -159,15 +230,10 @@ inline RetryPolicy fullJitterBackoff(std::chrono::microseconds base)
 //
 //     auto policy = capDelay(1000ms, equalJitterBackoff(10us));
 //
-inline RetryPolicy equalJitterBackoff(std::chrono::microseconds base)
+LT_RETRY_DECL RetryPolicy equalJitterBackoff(std::chrono::microseconds base)
 {
     return RetryPolicy([=](RetryStatus status) -> std::optional<std::chrono::microseconds> {
-        auto half_n = (base * static_cast<int>(std::pow(2, status.iteration_number))) / 2;
-
-        static thread_local std::mt19937 generator;
-        std::uniform_int_distribution<int> distribution(0, half_n.count());
-
-        return half_n + std::chrono::microseconds(distribution(generator));
+        return equalJitterDelay(backoffDelay(base, status.iteration_number));
     });
 }
 
@@ -182,16 +248,11 @@ inline RetryPolicy equalJitterBackoff(std::chrono::microseconds base)
 //
 //     auto policy = capDelay(1000ms, decorrelatedJitterBackoff(10us));
 //
-inline RetryPolicy decorrelatedJitterBackoff(std::chrono::microseconds base)
+LT_RETRY_DECL RetryPolicy decorrelatedJitterBackoff(std::chrono::microseconds base)
 {
     return RetryPolicy([=](RetryStatus status) -> std::optional<std::chrono::microseconds> {
         if (status.previous_delay) {
-            auto prev = *status.previous_delay;
-
-            static thread_local std::mt19937 generator;
-            std::uniform_int_distribution<int> distribution(0, prev.count() * 3);
-
-            return std::chrono::microseconds(distribution(generator));
+            return fullJitterDelay(*status.previous_delay * 3);
         } else {
             return std::nullopt;
         }
@@ -204,7 +265,7 @@ inline RetryPolicy decorrelatedJitterBackoff(std::chrono::microseconds base)
 // For example, `capDelay(1000us, exponentialBackoff(10us))` will never sleep
 // for longer than 1000us.
 //
-inline RetryPolicy capDelay(std::chrono::microseconds maxDelay, RetryPolicy policy)
+LT_RETRY_DECL RetryPolicy capDelay(std::chrono::microseconds maxDelay, RetryPolicy policy)
 {
     return RetryPolicy([=](RetryStatus status) -> std::optional<std::chrono::microseconds> {
         auto delay = policy(status);
@@ -217,4 +278,66 @@ inline RetryPolicy capDelay(std::chrono::microseconds maxDelay, RetryPolicy poli
     });
 }
 
+//
+// Deterministic slotted backoff: like fullJitterBackoff(), each delay falls
+// within a window [0, min(max_delay, base * 2^n)], but the position within
+// that window is derived from the client's identity and the attempt number
+// instead of drawn at random.
+//
+// The position is the bit-reversed client index (the van der Corput
+// sequence) rotated by n times the golden ratio. If a fleet's clients are
+// numbered 0..N-1, eg. by replica ordinal, the positions of any N of them
+// are spread as evenly as possible across each window, so no part of the
+// window sees more than its share of retries; the rotation moves each
+// client to a different part of the window at every attempt while keeping
+// that spread. Each client's schedule is reproducible.
+//
+// The cap is applied to the window before the slot is placed, so capped
+// attempts stay spread across [0, max_delay]; wrapping the policy in
+// capDelay() instead would pile every client whose slot lies beyond the cap
+// onto the cap itself. Combine it with limitRetries():
+//
+//     auto policy = slottedBackoff(10ms, 10s, replica_ordinal) + limitRetries(8);
+//
+LT_RETRY_DECL RetryPolicy slottedBackoff(
+    std::chrono::microseconds base, std::chrono::microseconds max_delay, std::uint64_t client_index)
+{
+    auto offset = detail::reverseBits(client_index);
+
+    return RetryPolicy([=](RetryStatus status) -> std::optional<std::chrono::microseconds> {
+        // 2^64 / golden ratio, ie. the fractional golden ratio in fixed point
+        constexpr std::uint64_t golden = 0x9e3779b97f4a7c15ull;
+
+        // min(max_delay, base * 2^n), without overflowing for large n
+        auto n = std::max(status.iteration_number, 0);
+        auto window = n < 62 && base.count() <= (max_delay.count() >> n) ? base * (std::int64_t(1) << n) : max_delay;
+
+        auto position = offset + golden * static_cast<std::uint64_t>(status.iteration_number);
+        auto fraction = static_cast<long double>(position) / 18446744073709551616.0L;
+
+        return std::chrono::microseconds(
+            static_cast<std::chrono::microseconds::rep>(fraction * static_cast<long double>(window.count())));
+    });
+}
+
+//
+// Slotted backoff for clients identified by name rather than by index. The
+// name is hashed (FNV-1a) to give the index, so each client remains
+// reproducible, but the fleet is only as evenly spread as the hashes are
+// uniform; prefer dense indices where they are available.
+//
+LT_RETRY_DECL RetryPolicy slottedBackoff(
+    std::chrono::microseconds base, std::chrono::microseconds max_delay, std::string_view client_id)
+{
+    std::uint64_t hash = 0xcbf29ce484222325ull;
+
+    for (unsigned char c : client_id) {
+        hash = (hash ^ c) * 0x100000001b3ull;
+    }
+
+    return slottedBackoff(base, max_delay, hash);
+}
+
+#endif
+
 }}  // namespace lt::retry
@@ -0,0 +1,224 @@
+#pragma once
+
+#include "lt/retry/retry-policy.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+#ifdef __linux__
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <poll.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace lt { namespace retry {
+
+// Something which can signal that a polled condition may have changed, so
+// that pollUntil() can check it straight away rather than waiting out the
+// policy's interval.
+class ReadinessSource
+{
+   public:
+    virtual ~ReadinessSource() = default;
+
+    // Wait at most `timeout` for a change. Returns true if woken by a
+    // change, false on timeout or once the source is closed. Spurious
+    // wakeups are allowed.
+    virtual bool wait(std::chrono::microseconds timeout) = 0;
+
+    // Whether the source can no longer report changes, eg. a pipe whose
+    // writer has gone. The poller then falls back to the policy's interval.
+    virtual bool closed() const { return false; }
+};
+
+#ifdef __linux__
+
+// Readiness of a file descriptor, eg. an eventfd, an inotify instance, a
+// pipe or a socket. When `drain` is set, one read() is issued after each
+// wakeup so that level-triggered descriptors such as eventfd and inotify
+// do not report the same change again. Without it such a descriptor stays
+// readable, and pollUntil() falls back to rechecking at most once per
+// millisecond until the condition holds.
+//
+// A descriptor reporting a hangup or error without data is closed.
+class FdReadiness : public ReadinessSource
+{
+   private:
+    int fd_;
+    bool drain_;
+    bool closed_ = false;
+
+   public:
+    explicit FdReadiness(int fd, bool drain = true) : fd_(fd), drain_(drain) {}
+
+    bool closed() const override { return closed_; }
+
+    bool wait(std::chrono::microseconds timeout) override
+    {
+        struct pollfd pfd = {fd_, POLLIN, 0};
+
+        // Round up so that short timeouts do not become a busy loop
+        auto ms = std::chrono::ceil<std::chrono::milliseconds>(timeout).count();
+        int rc = ::poll(&pfd, 1, static_cast<int>(std::min<std::int64_t>(ms, INT_MAX)));
+
+        if (rc <= 0) {
+            return false;
+        }
+
+        if (!(pfd.revents & POLLIN)) {
+            closed_ = (pfd.revents & (POLLHUP | POLLERR | POLLNVAL)) != 0;
+            return false;
+        }
+
+        if (drain_) {
+            char buf[4096];
+            (void)!::read(fd_, buf, sizeof(buf));
+        }
+
+        return true;
+    }
+};
+
+// Readiness signalled through a shared 32-bit word, without a file
+// descriptor. The waiter sleeps on the word with futex(2) until a notifier
+// calls `notify()`, which bumps the word and wakes it.
+class FutexReadiness : public ReadinessSource
+{
+   private:
+    std::atomic<std::uint32_t>& word_;
+    std::uint32_t seen_;
+
+    static long futex(std::atomic<std::uint32_t>* word, int op, std::uint32_t value, const struct timespec* timeout)
+    {
+        static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t), "futex word must be 32 bits");
+        return ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(word), op, value, timeout, nullptr, 0);
+    }
+
+   public:
+    explicit FutexReadiness(std::atomic<std::uint32_t>& word)
+        : word_(word),
+          seen_(word.load(std::memory_order_acquire))
+    {
+    }
+
+    static void notify(std::atomic<std::uint32_t>& word)
+    {
+        word.fetch_add(1, std::memory_order_release);
+        futex(&word, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr);
+    }
+
+    bool wait(std::chrono::microseconds timeout) override
+    {
+        auto current = word_.load(std::memory_order_acquire);
+
+        if (current == seen_) {
+            auto secs = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+            auto nsecs = std::chrono::duration_cast<std::chrono::nanoseconds>(timeout - secs);
+            struct timespec ts = {static_cast<time_t>(secs.count()), static_cast<long>(nsecs.count())};
+
+            futex(&word_, FUTEX_WAIT_PRIVATE, seen_, &ts);
+            current = word_.load(std::memory_order_acquire);
+        }
+
+        if (current == seen_) {
+            return false;
+        }
+
+        seen_ = current;
+        return true;
+    }
+};
+
+#endif
+
+//
+// Poll until `condition` holds, using `policy` for the interval between
+// checks. Returns true once the condition holds, or false if the policy
+// gives up first.
+//
+// If a readiness source is given, a change it reports wakes the poller to
+// check the condition immediately, so the latency of noticing a change is
+// that of the wakeup rather than the policy's interval:
+//
+//     int fd = inotify_init1(IN_NONBLOCK);
+//     inotify_add_watch(fd, dir, IN_CREATE | IN_MOVED_TO);
+//     FdReadiness ready(fd);
+//
+//     pollUntil(constantDelay(1s) + limitRetries(60),
+//               [&](RetryStatus) { return exists(path); }, &ready);
+//
+// An early check which finds the condition still false does not advance the
+// policy; the poller goes back to waiting for the rest of the interval.
+// Early checks are made at most once per millisecond, and once the source
+// is closed the poller just sleeps out each interval.
+//
+inline bool pollUntil(
+    const RetryPolicy& policy,
+    std::function<bool(RetryStatus)> condition,
+    ReadinessSource* source = nullptr)
+{
+    using clock = std::chrono::steady_clock;
+
+    RetryStatus status{};
+
+    while (true) {
+        if (condition(status)) {
+            return true;
+        }
+
+        auto new_status = policy.apply(status);
+
+        if (!new_status) {
+            return false;
+        }
+
+        status = *new_status;
+
+        auto delay = status.previous_delay.value_or(std::chrono::microseconds(0));
+
+        if (!source) {
+            std::this_thread::sleep_for(delay);
+            continue;
+        }
+
+        auto deadline = clock::now() + delay;
+        auto next_check = clock::now();
+
+        while (true) {
+            auto now = clock::now();
+            auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - now);
+
+            if (remaining.count() <= 0) {
+                break;
+            }
+
+            if (source->closed()) {
+                std::this_thread::sleep_for(remaining);
+                break;
+            }
+
+            if (now < next_check) {
+                // A source which keeps reporting the same change
+                std::this_thread::sleep_until(std::min(next_check, deadline));
+                continue;
+            }
+
+            if (source->wait(remaining)) {
+                if (condition(status)) {
+                    return true;
+                }
+
+                next_check = clock::now() + std::chrono::milliseconds(1);
+            }
+        }
+    }
+}
+
+}}  // namespace lt::retry
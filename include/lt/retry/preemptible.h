@@ -3,6 +3,7 @@
 #include "lt/retry/retry-policy.h"
 #include "lt/retry/policies.h"
 
+#include <algorithm>
 #include <condition_variable>
 
 namespace lt { namespace retry {
@@ -135,34 +136,40 @@ class PreemptibleRetry
         }
     }
 
+    // Lazy schedules of the statuses before and after the condition is
+    // signalled. The status is reset when the condition is signalled, so
+    // both start from the beginning.
+    RetrySchedule scheduleBefore() const & { return policy_before_.schedule(); }
+    RetrySchedule scheduleAfter() const & { return policy_after_.schedule(); }
+    RetrySchedule scheduleBefore() const && = delete;
+    RetrySchedule scheduleAfter() const && = delete;
+
     std::vector<PreemptibleRetryStatus> simulate(int n_before, int n_after) const
     {
-        RetryStatus status{};
         std::vector<PreemptibleRetryStatus> xs;
+        auto n = static_cast<std::size_t>(std::max(n_before, 0));
 
-        for (int i = 0; i < n_before; i++) {
-            auto new_status = policy_before_.apply(status);
+        if (n > 0) {
+            for (const auto& status : scheduleBefore()) {
+                xs.push_back(PreemptibleRetryStatus(status, false));
 
-            if (!new_status) {
-                return xs;
+                if (xs.size() == n) break;
             }
 
-            status = *new_status;
-            xs.push_back(PreemptibleRetryStatus(status, false));
+            // The first policy gave up before the condition was signalled
+            if (xs.size() < n) {
+                return xs;
+            }
         }
 
-        // Reset the status after the condition is signalled
-        status = {};
+        n += static_cast<std::size_t>(std::max(n_after, 0));
 
-        for (int i = 0; i < n_after; i++) {
-            auto new_status = policy_after_.apply(status);
+        if (xs.size() < n) {
+            for (const auto& status : scheduleAfter()) {
+                xs.push_back(PreemptibleRetryStatus(status, true));
 
-            if (!new_status) {
-                return xs;
+                if (xs.size() == n) break;
             }
-
-            status = *new_status;
-            xs.push_back(PreemptibleRetryStatus(status, true));
         }
 
         return xs;
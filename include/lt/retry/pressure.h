@@ -0,0 +1,175 @@
+#pragma once
+
+#include "lt/retry/retry-policy.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+namespace lt { namespace retry {
+
+// Percentage of wall time in which some task was stalled on each resource,
+// averaged over the last 10 seconds, as reported by Linux pressure stall
+// information (PSI).
+struct HostPressure
+{
+    double cpu;
+    double memory;
+    double io;
+
+    double worst() const { return std::max(cpu, std::max(memory, io)); }
+};
+
+// Samples /proc/pressure/{cpu,memory,io} on a background thread so that
+// policies can consult host pressure without touching the filesystem.
+//
+// Resources which are unavailable (older kernels, PSI disabled, non-Linux
+// hosts) read as zero pressure, so policies degrade to their undecorated
+// behaviour.
+
+class PressureSampler
+{
+   private:
+    std::string root_;
+    std::chrono::milliseconds interval_;
+
+    std::atomic<double> cpu_;
+    std::atomic<double> memory_;
+    std::atomic<double> io_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopping_ = false;
+    std::thread sampler_;
+
+    // Parse the "some avg10=..." line of a PSI file
+    static std::optional<double> readAvg10(const std::string& path)
+    {
+        std::FILE* file = std::fopen(path.c_str(), "r");
+
+        if (!file) {
+            return std::nullopt;
+        }
+
+        double avg10 = 0.0;
+        int matched = std::fscanf(file, "some avg10=%lf", &avg10);
+        std::fclose(file);
+
+        if (matched != 1) {
+            return std::nullopt;
+        }
+
+        return avg10;
+    }
+
+    void sample()
+    {
+        cpu_.store(readAvg10(root_ + "/cpu").value_or(0.0), std::memory_order_relaxed);
+        memory_.store(readAvg10(root_ + "/memory").value_or(0.0), std::memory_order_relaxed);
+        io_.store(readAvg10(root_ + "/io").value_or(0.0), std::memory_order_relaxed);
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        while (!cv_.wait_for(lock, interval_, [this]() { return stopping_; })) {
+            lock.unlock();
+            sample();
+            lock.lock();
+        }
+    }
+
+   public:
+    explicit PressureSampler(
+        std::chrono::milliseconds interval = std::chrono::seconds(1),
+        std::string root = "/proc/pressure")
+        : root_(std::move(root)),
+          interval_(interval),
+          cpu_(0.0),
+          memory_(0.0),
+          io_(0.0)
+    {
+        sample();
+        sampler_ = std::thread([this]() { run(); });
+    }
+
+    PressureSampler(const PressureSampler&) = delete;
+    PressureSampler& operator=(const PressureSampler&) = delete;
+
+    ~PressureSampler()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        sampler_.join();
+    }
+
+    HostPressure current() const
+    {
+        return HostPressure{
+            cpu_.load(std::memory_order_relaxed),
+            memory_.load(std::memory_order_relaxed),
+            io_.load(std::memory_order_relaxed)};
+    }
+};
+
+struct PressureThresholds
+{
+    // Pressure (percent stalled) above which delays start to be stretched
+    double scale_above = 10.0;
+
+    // Pressure at or above which retries are suppressed altogether
+    double suppress_above = 60.0;
+
+    // Factor by which delays are stretched just below `suppress_above`
+    double max_scale = 8.0;
+};
+
+//
+// Stretch the delays of a policy while the host is under CPU, memory or IO
+// pressure, and stop retrying altogether once pressure is severe. Between
+// the two thresholds the delay scales linearly from 1x to `max_scale`:
+//
+//     auto sampler = std::make_shared<PressureSampler>();
+//     auto policy = backoffOnHostPressure(sampler, capDelay(1s, fullJitterBackoff(10ms)));
+//
+inline RetryPolicy backoffOnHostPressure(
+    std::shared_ptr<PressureSampler> sampler,
+    RetryPolicy policy,
+    PressureThresholds thresholds = {})
+{
+    return RetryPolicy([=](RetryStatus status) -> std::optional<std::chrono::microseconds> {
+        auto delay = policy(status);
+
+        if (!delay) {
+            return std::nullopt;
+        }
+
+        auto pressure = sampler->current().worst();
+
+        if (pressure >= thresholds.suppress_above) {
+            return std::nullopt;
+        }
+
+        if (pressure <= thresholds.scale_above) {
+            return delay;
+        }
+
+        auto span = thresholds.suppress_above - thresholds.scale_above;
+        auto scale = 1.0 + (thresholds.max_scale - 1.0) * (pressure - thresholds.scale_above) / span;
+
+        return std::chrono::microseconds(static_cast<std::chrono::microseconds::rep>(delay->count() * scale));
+    });
+}
+
+}}  // namespace lt::retry
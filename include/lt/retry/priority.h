@@ -0,0 +1,59 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace lt { namespace retry {
+
+//
+// Priority class carried by a retry session. Lower values are more
+// important; when retry capacity is scarce, Batch retries are shed first and
+// Critical retries last.
+//
+enum class RetryPriority : std::uint8_t
+{
+    Critical = 0,
+    Interactive = 1,
+    Batch = 2,
+};
+
+constexpr std::size_t RETRY_PRIORITY_COUNT = 3;
+
+constexpr std::size_t priorityIndex(RetryPriority priority)
+{
+    return static_cast<std::size_t>(priority);
+}
+
+// Headroom held back from each priority class for the classes above it.
+//
+// `reserved[p]` is the fraction of a shared capacity which priority `p` may
+// not use. With the defaults, Batch retries stop being admitted once 70% of
+// capacity is in use, Interactive once 90% is, and Critical retries may use
+// all of it. A class which is not wholly reserved always gets at least one
+// unit of a non-zero capacity, so small capacities never starve it.
+
+struct PriorityReserve
+{
+    std::array<double, RETRY_PRIORITY_COUNT> reserved = {{0.0, 0.1, 0.3}};
+
+    // The share of `capacity` which `priority` may use.
+    std::size_t limit(std::size_t capacity, RetryPriority priority) const
+    {
+        auto fraction = reserved[priorityIndex(priority)];
+
+        if (fraction <= 0.0) {
+            return capacity;
+        }
+
+        if (fraction >= 1.0) {
+            return 0;
+        }
+
+        auto share = static_cast<std::size_t>(static_cast<double>(capacity) * (1.0 - fraction));
+        return capacity > 0 ? std::max<std::size_t>(share, 1) : 0;
+    }
+};
+
+}}  // namespace lt::retry
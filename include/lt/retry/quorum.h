@@ -0,0 +1,256 @@
+#pragma once
+
+#include "lt/retry/priority.h"
+#include "lt/retry/retry-policy.h"
+#include "lt/retry/scheduler.h"
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace lt { namespace retry {
+
+template <typename T>
+struct QuorumResult
+{
+    // Whether `k` targets succeeded
+    bool reached = false;
+
+    std::size_t successes = 0;
+
+    // The latest result of each target at the time the quorum was decided,
+    // or std::nullopt if none of its attempts had completed
+    std::vector<std::optional<T>> results;
+};
+
+//
+// Send to `n` targets in parallel and complete as soon as `k` of them
+// succeed, retrying only the targets which failed.
+//
+// Every attempt is dispatched through `scheduler`, each target following
+// its own RetryStatus under `policy`. A target is exhausted once the policy
+// gives up on it (or the scheduler refuses its retry); as soon as the
+// targets which have succeeded plus those not yet exhausted fall short of
+// `k`, the quorum is given up without waiting for the rest.
+//
+// `done` is called exactly once, when the quorum is reached or becomes
+// unreachable. Retries still waiting at that point are cancelled, freeing
+// their places in the scheduler, and results of attempts which were
+// already executing are discarded.
+//
+// Each target is its own RetryNode, so retries are scheduled without
+// allocating; a target keeps the quorum alive only while it is pending.
+//
+// ```
+//    retryQuorum<Ack>(scheduler, tenant, 2, policy,
+//                     [](Ack ack) { return ack.ok; }, {writeTo(a), writeTo(b), writeTo(c)},
+//                     [](QuorumResult<Ack> result) { ... });
+// ```
+//
+template <typename T>
+void retryQuorum(
+    RetryScheduler& scheduler,
+    TenantId tenant,
+    std::size_t k,
+    RetryPolicy policy,
+    std::function<bool(T)> isSuccess,
+    std::vector<std::function<T(RetryStatus)>> targets,
+    std::function<void(QuorumResult<T>)> done,
+    RetryPriority priority = RetryPriority::Interactive)
+{
+    struct Quorum;
+
+    struct Target : RetryNode
+    {
+        std::size_t index = 0;
+        std::function<T(RetryStatus)> action;
+
+        std::shared_ptr<Quorum> self;
+        RetryStatus next;
+
+        void fire() override
+        {
+            auto keep = std::move(self);
+            Quorum::attempt(keep, *this, next);
+        }
+
+        void drop() override
+        {
+            self.reset();
+        }
+    };
+
+    struct Quorum
+    {
+        RetryScheduler* scheduler;
+        TenantId tenant;
+        RetryPriority priority;
+        std::size_t k;
+        RetryPolicy policy;
+        std::function<bool(T)> isSuccess;
+        std::vector<Target> targets;
+        std::function<void(QuorumResult<T>)> done;
+
+        std::mutex mutex;
+        bool decided = false;
+        QuorumResult<T> result;
+
+        // Targets which have neither succeeded nor been exhausted
+        std::size_t live;
+
+        Quorum(
+            RetryScheduler* scheduler_,
+            TenantId tenant_,
+            RetryPriority priority_,
+            std::size_t k_,
+            RetryPolicy policy_,
+            std::function<bool(T)> isSuccess_,
+            std::vector<std::function<T(RetryStatus)>> targets_,
+            std::function<void(QuorumResult<T>)> done_)
+            : scheduler(scheduler_),
+              tenant(tenant_),
+              priority(priority_),
+              k(k_),
+              policy(std::move(policy_)),
+              isSuccess(std::move(isSuccess_)),
+              targets(targets_.size()),
+              done(std::move(done_)),
+              live(targets_.size())
+        {
+            for (std::size_t i = 0; i < targets.size(); i++) {
+                targets[i].index = i;
+                targets[i].action = std::move(targets_[i]);
+            }
+
+            result.results.resize(targets.size());
+        }
+
+        // Decide the quorum if possible, cancelling the retries still
+        // waiting; call with the mutex held. Returns true if this call
+        // decided it. The references the cancelled targets held are moved
+        // to `released`, to be dropped once the mutex is.
+        bool decide(std::vector<std::shared_ptr<Quorum>>& released)
+        {
+            if (decided) {
+                return false;
+            }
+
+            if (result.successes >= k) {
+                result.reached = true;
+            } else if (result.successes + live >= k) {
+                return false;
+            }
+
+            decided = true;
+
+            for (auto& target : targets) {
+                if (scheduler->cancel(target)) {
+                    released.push_back(std::move(target.self));
+                }
+            }
+
+            return true;
+        }
+
+        // Schedule a target's next attempt; call with the mutex held.
+        // Returns false if the scheduler refused it.
+        bool schedule(const std::shared_ptr<Quorum>& self, Target& target, std::chrono::microseconds delay, RetryStatus status)
+        {
+            target.next = status;
+            target.self = self;
+
+            if (scheduler->trySchedule(tenant, priority, delay, target) != RetryRejection::None) {
+                target.self.reset();
+                return false;
+            }
+
+            return true;
+        }
+
+        static void finish(const std::shared_ptr<Quorum>& self)
+        {
+            self->done(std::move(self->result));
+        }
+
+        static void attempt(const std::shared_ptr<Quorum>& self, Target& target, RetryStatus status)
+        {
+            {
+                std::lock_guard<std::mutex> lock(self->mutex);
+
+                if (self->decided) {
+                    return;
+                }
+            }
+
+            auto value = target.action(status);
+            bool success = self->isSuccess(value);
+
+            std::optional<RetryStatus> new_status;
+
+            if (!success) {
+                new_status = self->policy.apply(status);
+            }
+
+            std::vector<std::shared_ptr<Quorum>> released;
+            bool decided;
+            {
+                std::lock_guard<std::mutex> lock(self->mutex);
+
+                if (self->decided) {
+                    return;
+                }
+
+                self->result.results[target.index] = std::move(value);
+
+                if (success) {
+                    self->result.successes += 1;
+                }
+
+                if (new_status) {
+                    auto delay = new_status->previous_delay.value_or(std::chrono::microseconds(0));
+
+                    if (!self->schedule(self, target, delay, *new_status)) {
+                        new_status.reset();
+                    }
+                }
+
+                if (success || !new_status) {
+                    self->live -= 1;
+                }
+
+                decided = self->decide(released);
+            }
+
+            if (decided) {
+                finish(self);
+            }
+        }
+    };
+
+    auto quorum = std::make_shared<Quorum>(
+        &scheduler, tenant, priority, k, std::move(policy), std::move(isSuccess),
+        std::move(targets), std::move(done));
+
+    std::vector<std::shared_ptr<Quorum>> released;
+    bool decided;
+    {
+        std::lock_guard<std::mutex> lock(quorum->mutex);
+
+        for (auto& target : quorum->targets) {
+            if (!quorum->schedule(quorum, target, std::chrono::microseconds(0), RetryStatus{})) {
+                quorum->live -= 1;
+            }
+        }
+
+        decided = quorum->decide(released);
+    }
+
+    if (decided) {
+        Quorum::finish(quorum);
+    }
+}
+
+}}  // namespace lt::retry
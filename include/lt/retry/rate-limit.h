@@ -0,0 +1,248 @@
+#pragma once
+
+#include "lt/retry/priority.h"
+#include "lt/retry/retry-policy.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace lt { namespace retry {
+
+// Hard ceiling on the number of retries admitted within a sliding time
+// window. A single limiter is intended to be shared (via std::shared_ptr)
+// between all of the retry sessions which talk to one backend:
+// ```
+//    auto limiter = std::make_shared<SlidingWindowRateLimiter>(100, 1s);
+//
+//    auto policy = limitRetryRate(limiter, fullJitterBackoff(10ms));
+// ```
+//
+// The window is divided into `slots` buckets arranged in a ring with one
+// spare bucket, so that the slice following the current window can be
+// counted into without disturbing the slices still inside it. Each bucket
+// is a single atomic word holding the bucket's epoch (the index of the time
+// slice it currently counts) in the upper 32 bits and the number of retries
+// admitted in that slice in the lower 32 bits, so a stale bucket is recycled
+// and counted into with one compare-and-swap. No locks are taken.
+//
+// Admission increments the bucket for the slice being counted into first and
+// then sums the window ending at that slice and the window ending at the
+// next one, which may already hold retries counted ahead by
+// throttleRetryRate(); if either sum exceeds the limit the increment is
+// undone. Concurrent callers can therefore briefly see each other's
+// provisional increments and both be refused, but so long as retries are
+// only ever counted at most one slice ahead, no window ever holds more than
+// the limit.
+
+class SlidingWindowRateLimiter
+{
+   public:
+    using clock = std::chrono::steady_clock;
+
+   private:
+    int max_retries_;
+    std::uint64_t window_slots_;
+    std::chrono::microseconds slot_width_;
+    std::vector<std::atomic<std::uint64_t>> slots_;
+    clock::time_point origin_;
+
+    static std::uint64_t epochOf(std::uint64_t word) { return word >> 32; }
+    static std::uint64_t countOf(std::uint64_t word) { return word & 0xffffffffu; }
+
+    std::uint64_t sliceAt(clock::time_point now) const
+    {
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - origin_);
+        return static_cast<std::uint64_t>(elapsed / slot_width_) & 0xffffffffu;
+    }
+
+    std::atomic<std::uint64_t>& slotFor(std::uint64_t slice)
+    {
+        return slots_[slice % slots_.size()];
+    }
+
+    // Number of retries counted in slices (slice - slots, slice]
+    std::uint64_t countWindow(std::uint64_t slice) const
+    {
+        std::uint64_t total = 0;
+
+        for (const auto& slot : slots_) {
+            auto word = slot.load(std::memory_order_acquire);
+            auto age = (slice - epochOf(word)) & 0xffffffffu;
+
+            if (age < window_slots_) {
+                total += countOf(word);
+            }
+        }
+
+        return total;
+    }
+
+    void increment(std::uint64_t slice)
+    {
+        auto& slot = slotFor(slice);
+        auto word = slot.load(std::memory_order_relaxed);
+
+        while (true) {
+            auto desired = epochOf(word) == slice ? word + 1 : (slice << 32) | 1;
+
+            if (slot.compare_exchange_weak(word, desired, std::memory_order_acq_rel)) {
+                return;
+            }
+        }
+    }
+
+    void decrement(std::uint64_t slice)
+    {
+        auto& slot = slotFor(slice);
+        auto word = slot.load(std::memory_order_relaxed);
+
+        // If the slot has since been recycled for a later slice our
+        // increment has already expired along with it.
+        while (epochOf(word) == slice && countOf(word) > 0) {
+            if (slot.compare_exchange_weak(word, word - 1, std::memory_order_acq_rel)) {
+                return;
+            }
+        }
+    }
+
+   public:
+    explicit SlidingWindowRateLimiter(int max_retries, std::chrono::microseconds window, int slots = 16)
+        : max_retries_(max_retries),
+          window_slots_(static_cast<std::uint64_t>(std::max(slots, 1))),
+          slot_width_(std::max(std::chrono::microseconds(1), window / std::max(slots, 1))),
+          slots_(window_slots_ + 1),
+          origin_(clock::now())
+    {
+    }
+
+    SlidingWindowRateLimiter(const SlidingWindowRateLimiter&) = delete;
+    SlidingWindowRateLimiter& operator=(const SlidingWindowRateLimiter&) = delete;
+
+    int maxRetries() const { return max_retries_; }
+
+    std::chrono::microseconds slotWidth() const { return slot_width_; }
+
+    // Try to admit one retry at `now`, which may be at most one slice ahead
+    // of the current time. Returns false, without counting anything, if
+    // `limit` retries have already been admitted within the window ending at
+    // `now`, or within the window ending one slice later.
+    bool tryAcquire(int limit, clock::time_point now = clock::now())
+    {
+        if (limit <= 0) {
+            return false;
+        }
+
+        auto slice = sliceAt(now);
+        auto max = static_cast<std::uint64_t>(limit);
+
+        increment(slice);
+
+        if (countWindow(slice) > max || countWindow((slice + 1) & 0xffffffffu) > max) {
+            decrement(slice);
+            return false;
+        }
+
+        return true;
+    }
+
+    bool tryAcquire(clock::time_point now = clock::now())
+    {
+        return tryAcquire(max_retries_, now);
+    }
+
+    // Number of retries admitted within the window ending at `now`.
+    int inWindow(clock::time_point now = clock::now()) const
+    {
+        return static_cast<int>(countWindow(sliceAt(now)));
+    }
+
+    // Time until the oldest counted slice falls out of the window. This is
+    // the earliest point at which a refused retry could be admitted.
+    std::chrono::microseconds untilNextSlot(clock::time_point now = clock::now()) const
+    {
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - origin_);
+        return slot_width_ - (elapsed % slot_width_);
+    }
+};
+
+//
+// Stop retrying once the shared limiter has admitted its maximum number of
+// retries within the current window.
+//
+inline RetryPolicy limitRetryRate(std::shared_ptr<SlidingWindowRateLimiter> limiter, RetryPolicy policy)
+{
+    return RetryPolicy([=](RetryStatus status) -> std::optional<std::chrono::microseconds> {
+        auto delay = policy(status);
+
+        if (delay && !limiter->tryAcquire()) {
+            return std::nullopt;
+        }
+
+        return delay;
+    });
+}
+
+//
+// Priority-aware variant of limitRetryRate(). Each priority may only use its
+// share of the limiter's window, as given by `reserve`, so that low priority
+// sessions give up first and leave headroom for the classes above them.
+//
+inline RetryPolicy limitRetryRate(
+    std::shared_ptr<SlidingWindowRateLimiter> limiter,
+    RetryPriority priority,
+    RetryPolicy policy,
+    PriorityReserve reserve = {})
+{
+    auto limit = static_cast<int>(reserve.limit(static_cast<std::size_t>(limiter->maxRetries()), priority));
+
+    return RetryPolicy([=](RetryStatus status) -> std::optional<std::chrono::microseconds> {
+        auto delay = policy(status);
+
+        if (delay && !limiter->tryAcquire(limit)) {
+            return std::nullopt;
+        }
+
+        return delay;
+    });
+}
+
+//
+// As limitRetryRate(), but rather than giving up when the window is full
+// the delay is stretched until the next slot frees up. A retry which fits in
+// the current window is counted now, as limitRetryRate() counts it, even if
+// its own delay carries it into a later slice; one whose delay is stretched
+// is counted against the slice in which it will run. Only the slice
+// following the current one can be counted ahead, so if the stretched delay
+// would carry the retry beyond it, or the window ending at that slice is
+// also full, the policy gives up.
+//
+inline RetryPolicy throttleRetryRate(std::shared_ptr<SlidingWindowRateLimiter> limiter, RetryPolicy policy)
+{
+    return RetryPolicy([=](RetryStatus status) -> std::optional<std::chrono::microseconds> {
+        auto delay = policy(status);
+
+        if (!delay) {
+            return std::nullopt;
+        }
+
+        auto now = SlidingWindowRateLimiter::clock::now();
+
+        if (limiter->tryAcquire(now)) {
+            return delay;
+        }
+
+        auto wait = limiter->untilNextSlot(now);
+        auto target = std::max(*delay, wait);
+
+        if (target < wait + limiter->slotWidth() && limiter->tryAcquire(now + target)) {
+            return target;
+        }
+
+        return std::nullopt;
+    });
+}
+
+}}  // namespace lt::retry
@@ -0,0 +1,376 @@
+#pragma once
+
+#include "lt/retry/retry-policy.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace lt { namespace retry {
+
+using ConnectionId = std::uint64_t;
+
+struct ReconnectConfig
+{
+    // Each period a connection stays up removes one level of backoff, so
+    // the next outage starts lower rather than back at the base.
+    std::chrono::microseconds stable_after = std::chrono::seconds(30);
+
+    // A connection which drops within this long of being established is
+    // flapping. Each flap adds `flap_penalty` levels on top of the normal
+    // one, so a connection which keeps dropping straight away backs off
+    // further rather than reconnecting at the same rate.
+    std::chrono::microseconds flap_window = std::chrono::seconds(5);
+    int flap_penalty = 1;
+
+    int max_level = 30;
+};
+
+// Owns the backoff state of many long-lived connections.
+//
+// Unlike retry<T>, whose RetryStatus lives only as long as one call, the
+// manager keeps a compact state per connection across connects and
+// disconnects. The backoff level is used as the RetryStatus
+// iteration_number when asking the policy for the next delay, so any
+// RetryPolicy can drive reconnection:
+// ```
+//    ReconnectManager manager(capDelay(30s, fullJitterBackoff(100ms)),
+//                             [&](ConnectionId id) { startConnect(id); });
+//    manager.start();
+//
+//    manager.add(id);                // schedules the first attempt
+//    ...
+//    manager.connected(id);          // from the connect callback
+//    manager.failed(id);             // or if the attempt failed
+//    manager.disconnected(id);       // when an established connection drops
+// ```
+//
+// A reconnect callback is invoked for each attempt which falls due, either
+// from the manager's own timer thread after `start()`, or from an existing
+// event loop which calls `poll()` and waits at most `untilNextDue()`.
+// Callbacks are invoked without the manager's lock held, so they may call
+// back into it.
+//
+// Instead of snapping back to the base after a success, the level decays
+// with the time the connection has been stable. If the policy gives up on a
+// connection it is left abandoned until it is added again.
+
+class ReconnectManager
+{
+   public:
+    using clock = std::chrono::steady_clock;
+
+    enum class State : std::uint8_t
+    {
+        Waiting,
+        Connecting,
+        Connected,
+        Abandoned,
+    };
+
+   private:
+    struct Connection
+    {
+        std::int64_t since;           // us, time of the last state change
+        std::int64_t due;             // us, time of the next attempt while Waiting
+        std::int64_t previous_delay;  // us, -1 if none
+        std::uint16_t level;
+        std::uint16_t flaps;          // consecutive flaps
+        State state;
+    };
+
+    struct Due
+    {
+        std::int64_t due;
+        ConnectionId id;
+
+        bool operator<(const Due& other) const { return due > other.due; }
+    };
+
+    RetryPolicy policy_;
+    std::function<void(ConnectionId)> reconnect_;
+    ReconnectConfig config_;
+
+    std::unordered_map<ConnectionId, Connection> connections_;
+    std::vector<Due> timers_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopping_ = false;
+    std::thread timer_;
+
+    static std::int64_t ticks(clock::time_point t)
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(t.time_since_epoch()).count();
+    }
+
+    void schedule(ConnectionId id, Connection& c, std::int64_t now)
+    {
+        RetryStatus status{};
+        status.iteration_number = c.level;
+
+        if (c.previous_delay >= 0) {
+            status.previous_delay = std::chrono::microseconds(c.previous_delay);
+        }
+
+        auto delay = policy_(status);
+
+        if (!delay) {
+            c.state = State::Abandoned;
+            c.since = now;
+            return;
+        }
+
+        c.state = State::Waiting;
+        c.since = now;
+        c.due = now + delay->count();
+        c.previous_delay = delay->count();
+        c.level = static_cast<std::uint16_t>(std::min<int>(c.level + 1, config_.max_level));
+
+        timers_.push_back(Due{c.due, id});
+        std::push_heap(timers_.begin(), timers_.end());
+        cv_.notify_all();
+    }
+
+    // Levels of backoff earned back by having been connected since `since`
+    int decay(const Connection& c, std::int64_t now) const
+    {
+        if (c.state != State::Connected || config_.stable_after.count() <= 0) {
+            return 0;
+        }
+
+        return static_cast<int>(std::min<std::int64_t>((now - c.since) / config_.stable_after.count(), 0xffff));
+    }
+
+    // Collect the connections whose attempts are due at `now`, marking them
+    // Connecting. Entries left in the heap by connections which have since
+    // been rescheduled or removed are discarded here.
+    std::vector<ConnectionId> takeDue(std::int64_t now)
+    {
+        std::vector<ConnectionId> due;
+
+        while (!timers_.empty() && timers_.front().due <= now) {
+            std::pop_heap(timers_.begin(), timers_.end());
+            auto timer = timers_.back();
+            timers_.pop_back();
+
+            auto it = connections_.find(timer.id);
+
+            if (it == connections_.end() || it->second.state != State::Waiting || it->second.due != timer.due) {
+                continue;
+            }
+
+            it->second.state = State::Connecting;
+            it->second.since = now;
+            due.push_back(timer.id);
+        }
+
+        return due;
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        while (!stopping_) {
+            auto due = takeDue(ticks(clock::now()));
+
+            if (!due.empty()) {
+                lock.unlock();
+                for (auto id : due) {
+                    reconnect_(id);
+                }
+                lock.lock();
+                continue;
+            }
+
+            if (timers_.empty()) {
+                cv_.wait(lock);
+            } else {
+                cv_.wait_until(lock, clock::time_point(std::chrono::microseconds(timers_.front().due)));
+            }
+        }
+    }
+
+   public:
+    explicit ReconnectManager(
+        RetryPolicy policy,
+        std::function<void(ConnectionId)> reconnect,
+        ReconnectConfig config = {})
+        : policy_(std::move(policy)),
+          reconnect_(std::move(reconnect)),
+          config_(config)
+    {
+    }
+
+    ReconnectManager(const ReconnectManager&) = delete;
+    ReconnectManager& operator=(const ReconnectManager&) = delete;
+
+    ~ReconnectManager()
+    {
+        stop();
+    }
+
+    // Drive reconnect attempts from an internal timer thread
+    void start()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (!timer_.joinable()) {
+            stopping_ = false;
+            timer_ = std::thread([this]() { run(); });
+        }
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+
+        if (timer_.joinable()) {
+            timer_.join();
+        }
+    }
+
+    // Event loop integration: invoke the callback for every attempt due at
+    // `now`. Returns the number of attempts started.
+    std::size_t poll(clock::time_point now = clock::now())
+    {
+        std::vector<ConnectionId> due;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            due = takeDue(ticks(now));
+        }
+
+        for (auto id : due) {
+            reconnect_(id);
+        }
+
+        return due.size();
+    }
+
+    // Time until the next attempt falls due, if any are scheduled
+    std::optional<std::chrono::microseconds> untilNextDue(clock::time_point now = clock::now())
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (timers_.empty()) {
+            return std::nullopt;
+        }
+
+        return std::chrono::microseconds(std::max<std::int64_t>(0, timers_.front().due - ticks(now)));
+    }
+
+    // Start managing a connection, with an attempt due immediately
+    void add(ConnectionId id, clock::time_point now = clock::now())
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto t = ticks(now);
+
+        connections_[id] = Connection{t, t, -1, 0, 0, State::Waiting};
+        timers_.push_back(Due{t, id});
+        std::push_heap(timers_.begin(), timers_.end());
+        cv_.notify_all();
+    }
+
+    void remove(ConnectionId id)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connections_.erase(id);
+    }
+
+    // The attempt succeeded
+    void connected(ConnectionId id, clock::time_point now = clock::now())
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = connections_.find(id);
+
+        if (it != connections_.end()) {
+            it->second.state = State::Connected;
+            it->second.since = ticks(now);
+        }
+    }
+
+    // The attempt failed: back off one more level
+    void failed(ConnectionId id, clock::time_point now = clock::now())
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = connections_.find(id);
+
+        if (it != connections_.end() && it->second.state == State::Connecting) {
+            schedule(id, it->second, ticks(now));
+        }
+    }
+
+    // An established connection dropped
+    void disconnected(ConnectionId id, clock::time_point now = clock::now())
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = connections_.find(id);
+
+        if (it == connections_.end() || it->second.state != State::Connected) {
+            return;
+        }
+
+        auto& c = it->second;
+        auto t = ticks(now);
+        auto stable = decay(c, t);
+
+        // The penalty is added once per flap; it compounds through the level
+        // itself, so a connection which keeps flapping climbs steadily
+        bool flapped = t - c.since < config_.flap_window.count();
+
+        if (flapped) {
+            c.flaps = static_cast<std::uint16_t>(std::min<int>(c.flaps + 1, 0xffff));
+        } else {
+            c.flaps = 0;
+        }
+
+        int level = std::max(0, c.level - stable) + (flapped ? config_.flap_penalty : 0);
+        c.level = static_cast<std::uint16_t>(std::min(level, config_.max_level));
+
+        if (c.level == 0) {
+            c.previous_delay = -1;
+        }
+
+        schedule(id, c, t);
+    }
+
+    std::optional<State> state(ConnectionId id)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = connections_.find(id);
+
+        if (it == connections_.end()) {
+            return std::nullopt;
+        }
+
+        return it->second.state;
+    }
+
+    // Current backoff level, after any decay earned by a connection which
+    // is up at `now`
+    std::optional<int> level(ConnectionId id, clock::time_point now = clock::now())
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = connections_.find(id);
+
+        if (it == connections_.end()) {
+            return std::nullopt;
+        }
+
+        return std::max(0, it->second.level - decay(it->second, ticks(now)));
+    }
+};
+
+}}  // namespace lt::retry
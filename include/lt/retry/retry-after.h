@@ -0,0 +1,198 @@
+#pragma once
+
+#include "lt/retry/policies.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+namespace lt { namespace retry {
+
+// Lock-free estimate of a local queue's depth and drain rate, for servers
+// which want to tell their clients when to come back.
+//
+// Producers and consumers call `enqueued()` and `dequeued()`; both are a
+// single relaxed atomic add. The drain rate is an exponentially weighted
+// moving average of completions per second, refreshed at most once per
+// `sample_interval` by whichever caller of `drainRate()` first notices it is
+// stale. The average is seeded with the first sample, and until that has
+// been taken there is no estimate.
+
+class QueueDepthEstimator
+{
+   public:
+    using clock = std::chrono::steady_clock;
+
+   private:
+    std::chrono::microseconds sample_interval_;
+    double alpha_;
+
+    std::atomic<std::int64_t> depth_{0};
+    std::atomic<std::uint64_t> completed_{0};
+
+    std::atomic<std::int64_t> sampled_at_;
+    std::atomic<std::uint64_t> sampled_completed_{0};
+    std::atomic<double> rate_{0.0};
+    std::atomic<bool> has_rate_{false};
+
+    static std::int64_t ticks(clock::time_point t)
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(t.time_since_epoch()).count();
+    }
+
+   public:
+    explicit QueueDepthEstimator(
+        std::chrono::microseconds sample_interval = std::chrono::milliseconds(100),
+        double alpha = 0.2)
+        : sample_interval_(sample_interval),
+          alpha_(alpha),
+          sampled_at_(ticks(clock::now()))
+    {
+    }
+
+    QueueDepthEstimator(const QueueDepthEstimator&) = delete;
+    QueueDepthEstimator& operator=(const QueueDepthEstimator&) = delete;
+
+    void enqueued(std::int64_t n = 1)
+    {
+        depth_.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    void dequeued(std::int64_t n = 1)
+    {
+        depth_.fetch_sub(n, std::memory_order_relaxed);
+        completed_.fetch_add(static_cast<std::uint64_t>(n), std::memory_order_relaxed);
+    }
+
+    std::int64_t depth() const
+    {
+        return std::max<std::int64_t>(0, depth_.load(std::memory_order_relaxed));
+    }
+
+    // Completions per second, or std::nullopt before the first sample
+    std::optional<double> drainRate(clock::time_point now = clock::now())
+    {
+        auto now_ticks = ticks(now);
+        auto last = sampled_at_.load(std::memory_order_acquire);
+        auto elapsed = now_ticks - last;
+
+        // Only the caller which wins the race to advance the sample time
+        // folds in the new sample.
+        if (elapsed >= sample_interval_.count() &&
+            sampled_at_.compare_exchange_strong(last, now_ticks, std::memory_order_acq_rel)) {
+            auto completed = completed_.load(std::memory_order_relaxed);
+            auto previous = sampled_completed_.exchange(completed, std::memory_order_relaxed);
+            auto instantaneous = static_cast<double>(completed - previous) * 1e6 / static_cast<double>(elapsed);
+
+            if (has_rate_.load(std::memory_order_relaxed)) {
+                auto rate = rate_.load(std::memory_order_relaxed);
+                rate_.store(alpha_ * instantaneous + (1.0 - alpha_) * rate, std::memory_order_relaxed);
+            } else {
+                rate_.store(instantaneous, std::memory_order_relaxed);
+                has_rate_.store(true, std::memory_order_release);
+            }
+        }
+
+        if (!has_rate_.load(std::memory_order_acquire)) {
+            return std::nullopt;
+        }
+
+        return rate_.load(std::memory_order_relaxed);
+    }
+};
+
+struct RetryAfterConfig
+{
+    // Backoff applied to a client's reported attempt number, as for
+    // exponentialBackoff(base)
+    std::chrono::microseconds base = std::chrono::milliseconds(100);
+
+    std::chrono::microseconds min_delay = std::chrono::milliseconds(0);
+    std::chrono::microseconds max_delay = std::chrono::seconds(60);
+};
+
+// Server-side companion to the client policies: computes the Retry-After
+// to send to a client which has been turned away.
+//
+// The window is the larger of the time the current queue needs to drain and
+// the backoff the client would have applied itself at its reported attempt
+// number, clamped to [min_delay, max_delay]. Until the queue has a drain
+// rate estimate, eg. just after the server starts, the backoff alone is
+// used. The returned value is drawn with equal jitter over that window, the
+// same math as equalJitterBackoff(), so rejected clients spread out over
+// the second half of the window rather than all returning the moment the
+// queue is expected to be empty.
+//
+// ```
+//    auto queue = std::make_shared<QueueDepthEstimator>();
+//    RetryAfterAdvisor advisor(queue);
+//
+//    response.setHeader("Retry-After", advisor.retryAfterSeconds(request.attempt()));
+// ```
+
+class RetryAfterAdvisor
+{
+   private:
+    std::shared_ptr<QueueDepthEstimator> queue_;
+    RetryAfterConfig config_;
+
+   public:
+    explicit RetryAfterAdvisor(std::shared_ptr<QueueDepthEstimator> queue, RetryAfterConfig config = {})
+        : queue_(std::move(queue)),
+          config_(config)
+    {
+    }
+
+    // Expected time for the current queue to drain, or zero if the drain
+    // rate is not yet known
+    std::chrono::microseconds drainTime() const
+    {
+        auto depth = queue_->depth();
+
+        if (depth == 0) {
+            return std::chrono::microseconds(0);
+        }
+
+        auto rate = queue_->drainRate();
+
+        if (!rate) {
+            return std::chrono::microseconds(0);
+        }
+
+        if (*rate <= 0.0) {
+            return config_.max_delay;
+        }
+
+        auto seconds = static_cast<double>(depth) / *rate;
+        auto max_seconds = std::chrono::duration<double>(config_.max_delay).count();
+
+        if (seconds >= max_seconds) {
+            return config_.max_delay;
+        }
+
+        return std::chrono::microseconds(static_cast<std::chrono::microseconds::rep>(seconds * 1e6));
+    }
+
+    std::chrono::microseconds retryAfter(int client_attempt) const
+    {
+        // Attempt numbers come from the client, so bound them before doubling
+        auto backoff = backoffDelay(config_.base, std::min(std::max(client_attempt, 0), 30));
+        auto window = std::clamp(std::max(drainTime(), backoff), config_.min_delay, config_.max_delay);
+
+        return equalJitterDelay(window);
+    }
+
+    // Retry-After header value: whole seconds, rounded up so that clients
+    // never come back earlier than advised
+    std::int64_t retryAfterSeconds(int client_attempt) const
+    {
+        auto delay = retryAfter(client_attempt);
+
+        return std::chrono::ceil<std::chrono::seconds>(delay).count();
+    }
+};
+
+}}  // namespace lt::retry
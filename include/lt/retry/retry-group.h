@@ -0,0 +1,158 @@
+#pragma once
+
+#include "lt/retry/policies.h"
+#include "lt/retry/preemptible.h"
+#include "lt/retry/retry-policy.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace lt { namespace retry {
+
+// Limits on a whole RetryGroup session, which unlike the policy's are not
+// reset when the group recovers. Zero means no limit.
+struct RetryGroupLimits
+{
+    // Attempts, including the first
+    int max_attempts = 0;
+
+    // Time since the session started, beyond which it does not start
+    // another backoff
+    std::chrono::microseconds max_elapsed{0};
+};
+
+// Retry sessions which talk to the same backend, sharing the discovery that
+// it has recovered.
+//
+// When any session in the group succeeds, every session currently backing
+// off is woken, its retry status is reset (as PreemptibleRetry does when its
+// condition is signalled) and it tries again straight away, or after a
+// random stagger of up to `stagger` so that the recovered backend is not hit
+// by the whole group at once:
+// ```
+//    RetryGroup backend(std::chrono::milliseconds(50));
+//
+//    auto isSuccess = [](Result result) { return result == Result::SUCCESS; };
+//
+//    backend.retry<Result>(policy, shouldRetry, action, isSuccess);
+// ```
+//
+// Unlike PreemptibleRetry there is no condition variable, mutex or flag for
+// the caller to manage: the group owns them, and successes are reported by
+// the sessions themselves. Other code which learns that the backend is back
+// (eg. a health check) can call `notifySuccess()` directly.
+//
+// A success which happens while a session's own attempt is in flight also
+// counts, so a session never sleeps through a recovery it raced with.
+//
+// A reset restarts the policy, including any limits it applies, such as
+// limitRetries() or limitCumulativeDelay(). To stop a session whose own
+// request keeps failing while the rest of the group succeeds, pass
+// RetryGroupLimits, which count the whole session.
+
+class RetryGroup
+{
+   private:
+    std::chrono::microseconds stagger_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::uint64_t generation_ = 0;
+
+    std::uint64_t generation()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return generation_;
+    }
+
+    // Sleep for `delay` unless a success is reported after `seen`. Returns
+    // true if woken by a success.
+    bool waitFor(std::chrono::microseconds delay, std::uint64_t seen)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return cv_.wait_for(lock, delay, [&]() { return generation_ != seen; });
+    }
+
+   public:
+    explicit RetryGroup(std::chrono::microseconds stagger = std::chrono::microseconds(0))
+        : stagger_(stagger)
+    {
+    }
+
+    RetryGroup(const RetryGroup&) = delete;
+    RetryGroup& operator=(const RetryGroup&) = delete;
+
+    // Wake every session in the group which is backing off
+    void notifySuccess()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            generation_ += 1;
+        }
+        cv_.notify_all();
+    }
+
+    template <typename T>
+    T retry(
+        const RetryPolicy& policy,
+        std::function<bool(PreemptibleRetryStatus, T)> shouldRetry,
+        std::function<T(PreemptibleRetryStatus)> action,
+        std::function<bool(T)> isSuccess,
+        RetryGroupLimits limits = {})
+    {
+        PreemptibleRetryStatus status{};
+
+        // Counted over the whole session, ignoring resets
+        int attempts = 0;
+        auto started = std::chrono::steady_clock::now();
+
+        while (true) {
+            auto seen = generation();
+            auto result = action(status);
+            attempts += 1;
+
+            if (isSuccess(result)) {
+                notifySuccess();
+            }
+
+            if (!shouldRetry(status, result)) {
+                return result;
+            }
+
+            if (limits.max_attempts > 0 && attempts >= limits.max_attempts) {
+                return result;
+            }
+
+            auto new_status = policy.apply(status);
+
+            if (!new_status) {
+                return result;
+            }
+
+            auto delay = new_status->previous_delay.value_or(std::chrono::microseconds(0));
+
+            if (limits.max_elapsed.count() > 0 &&
+                std::chrono::steady_clock::now() - started + delay > limits.max_elapsed) {
+                return result;
+            }
+
+            if (waitFor(delay, seen)) {
+                // The backend is back: start the policy afresh, as
+                // PreemptibleRetry does once its condition is signalled
+                if (stagger_.count() > 0) {
+                    std::this_thread::sleep_for(fullJitterDelay(stagger_));
+                }
+
+                status = PreemptibleRetryStatus(RetryStatus{}, true);
+            } else {
+                status = PreemptibleRetryStatus(*new_status, false);
+            }
+        }
+    }
+};
+
+}}  // namespace lt::retry
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace lt { namespace retry {
+
+class RetryScheduler;
+
+// A retry which can be scheduled on a RetryScheduler without any allocation.
+//
+// The node carries the links the scheduler needs to hold it in its timer
+// heap and its per-tenant ready lists, so it is meant to be embedded in
+// (derived from by) the caller's own request struct:
+// ```
+//    struct Request : RetryNode
+//    {
+//        RetryStatus status;
+//        ...
+//        void fire() override { ... attempt, and perhaps trySchedule(*this) again ... }
+//    };
+//
+//    scheduler.trySchedule(tenant, priority, delay, request);
+// ```
+//
+// A node may be pending on at most one scheduler at a time, and must stay
+// alive until it has fired, been cancelled or been dropped. A node which has
+// been dispatched but whose fire() has not yet been called is still pending
+// and can no longer be cancelled. Once fire() is called the scheduler no
+// longer refers to the node, so fire() may schedule it again or destroy it.
+
+class RetryNode
+{
+   public:
+    RetryNode() = default;
+
+    RetryNode(const RetryNode&) = delete;
+    RetryNode& operator=(const RetryNode&) = delete;
+
+    virtual ~RetryNode() = default;
+
+    // Run the retry, on the scheduler's executor
+    virtual void fire() = 0;
+
+    // Called instead of fire() for a node which was still pending when its
+    // scheduler was destroyed
+    virtual void drop() {}
+
+    bool pending() const { return state_.load(std::memory_order_acquire) != State::Idle; }
+
+   private:
+    friend class RetryScheduler;
+
+    enum class State
+    {
+        Idle,
+        Waiting,
+        Ready,
+        Dispatched,
+    };
+
+    std::atomic<State> state_{State::Idle};
+    std::chrono::steady_clock::time_point due_;
+    std::uint64_t sequence_ = 0;
+    std::size_t bytes_ = 0;
+    void* flow_ = nullptr;
+
+    // Pairing heap links while waiting: first child, next sibling, and
+    // parent or previous sibling. While ready, next_ and prev_ link the
+    // flow's FIFO instead.
+    RetryNode* child_ = nullptr;
+    RetryNode* next_ = nullptr;
+    RetryNode* prev_ = nullptr;
+};
+
+// Slab allocator for nodes which are not embedded in a longer-lived struct.
+//
+// Nodes are carved out of chunks of `chunk_size` and recycled through a free
+// list, so once the pool has grown to its working size, creating and
+// destroying nodes never touches the general-purpose allocator. The pool
+// must outlive every node created from it.
+//
+// ```
+//    RetryNodePool<Request> requests;
+//
+//    auto* request = requests.create(...);
+//    ...
+//    requests.destroy(request);
+// ```
+
+template <typename T>
+class RetryNodePool
+{
+   private:
+    union Slot
+    {
+        Slot* next;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    std::size_t chunk_size_;
+    std::vector<std::unique_ptr<Slot[]>> chunks_;
+    Slot* free_ = nullptr;
+    std::size_t live_ = 0;
+
+    mutable std::mutex mutex_;
+
+    void grow()
+    {
+        chunks_.emplace_back(new Slot[chunk_size_]);
+        auto* chunk = chunks_.back().get();
+
+        for (std::size_t i = chunk_size_; i > 0; i--) {
+            chunk[i - 1].next = free_;
+            free_ = &chunk[i - 1];
+        }
+    }
+
+    void* allocate()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (!free_) {
+            grow();
+        }
+
+        auto* slot = free_;
+        free_ = slot->next;
+        live_ += 1;
+
+        return slot->storage;
+    }
+
+    void deallocate(void* p)
+    {
+        auto* slot = reinterpret_cast<Slot*>(p);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        slot->next = free_;
+        free_ = slot;
+        live_ -= 1;
+    }
+
+   public:
+    explicit RetryNodePool(std::size_t chunk_size = 1024, std::size_t reserve = 0)
+        : chunk_size_(chunk_size > 0 ? chunk_size : 1)
+    {
+        for (std::size_t n = 0; n < reserve; n += chunk_size_) {
+            grow();
+        }
+    }
+
+    RetryNodePool(const RetryNodePool&) = delete;
+    RetryNodePool& operator=(const RetryNodePool&) = delete;
+
+    template <typename... Args>
+    T* create(Args&&... args)
+    {
+        auto* p = allocate();
+
+        try {
+            return new (p) T(std::forward<Args>(args)...);
+        } catch (...) {
+            deallocate(p);
+            throw;
+        }
+    }
+
+    void destroy(T* node)
+    {
+        node->~T();
+        deallocate(node);
+    }
+
+    // Nodes created and not yet destroyed
+    std::size_t live() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return live_;
+    }
+};
+
+}}  // namespace lt::retry
@@ -1,11 +1,21 @@
 #pragma once
 
-#include <iostream>
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
 #include <functional>
+#include <iosfwd>
+#include <iterator>
 #include <optional>
 #include <thread>
 #include <vector>
 
+#if __cplusplus >= 202002L && __has_include(<ranges>)
+#include <ranges>
+#endif
+
 namespace lt { namespace retry {
 
 struct RetryStatus
@@ -15,20 +25,69 @@ struct RetryStatus
     std::optional<std::chrono::microseconds> previous_delay;
 };
 
-inline std::ostream &operator<<(std::ostream &stream, const RetryStatus &status)
+// Upper bound on the length of a formatted RetryStatus, including the
+// terminating NUL
+constexpr std::size_t RETRY_STATUS_FORMAT_MAX = 128;
+
+//
+// Render a status into `buf` without allocating, as
+//
+//     { iteration_number: 2, cumulative_delay: 3000us, previous_delay: 2000us }
+//
+// At most `n` bytes are written, always NUL terminated if `n` is non-zero.
+// Like snprintf, returns the length of the full rendering (excluding the
+// NUL), so truncation is detected by a result >= n. A buffer of
+// RETRY_STATUS_FORMAT_MAX bytes is always large enough.
+//
+inline std::size_t formatTo(char* buf, std::size_t n, const RetryStatus& status)
 {
-    stream << "{ iteration_number: " << status.iteration_number
-           << ", cumulative_delay: " << status.cumulative_delay.count() << "us";
+    char tmp[RETRY_STATUS_FORMAT_MAX];
+    char* out = tmp;
+    char* const end = tmp + sizeof(tmp);
+
+    auto text = [&](const char* s) {
+        auto len = std::strlen(s);
+        std::memcpy(out, s, len);
+        out += len;
+    };
+
+    text("{ iteration_number: ");
+    out = std::to_chars(out, end, status.iteration_number).ptr;
+    text(", cumulative_delay: ");
+    out = std::to_chars(out, end, status.cumulative_delay.count()).ptr;
+    text("us, previous_delay: ");
 
     if (status.previous_delay) {
-        stream << ", previous_delay: " << status.previous_delay->count() << "us";
+        out = std::to_chars(out, end, status.previous_delay->count()).ptr;
+        text("us }");
     } else {
-        stream << ", previous_delay: none";
+        text("none }");
+    }
+
+    auto len = static_cast<std::size_t>(out - tmp);
+
+    if (n > 0) {
+        auto copied = std::min(len, n - 1);
+        std::memcpy(buf, tmp, copied);
+        buf[copied] = '\0';
     }
 
-    return stream << " }";
+    return len;
 }
 
+// Only <iosfwd> is needed here: the stream operations are instantiated
+// where a stream is actually used, and that code includes <ostream>.
+template <typename CharT, typename Traits>
+std::basic_ostream<CharT, Traits>& operator<<(std::basic_ostream<CharT, Traits>& stream, const RetryStatus& status)
+{
+    char buf[RETRY_STATUS_FORMAT_MAX];
+    formatTo(buf, sizeof(buf), status);
+
+    return stream << buf;
+}
+
+class RetrySchedule;
+
 class RetryPolicy
 {
    private:
@@ -115,24 +174,130 @@ class RetryPolicy
         }
     }
 
-    std::vector<RetryStatus> simulate(int n) const
+    // Lazily yield the successive statuses this policy would produce,
+    // starting from `status`. See RetrySchedule.
+    RetrySchedule schedule(RetryStatus status = {}) const &;
+    RetrySchedule schedule(RetryStatus status = {}) const && = delete;
+
+    std::vector<RetryStatus> simulate(int n) const;
+};
+
+// Lazy, allocation-free view over the statuses a policy produces, one per
+// retry, ending when the policy gives up. The policy is only evaluated as
+// the view is iterated, so arbitrarily long (or unbounded) schedules can be
+// streamed and abandoned early:
+// ```
+//    for (auto status : policy.schedule()) {
+//        if (status.cumulative_delay > 10s) break;
+//        ...
+//    }
+// ```
+//
+// With C++20 the schedule is a std::ranges::view, and composes with the
+// standard range adaptors:
+// ```
+//    auto within10s = policy.schedule()
+//        | std::views::take_while([](const RetryStatus& s) { return s.cumulative_delay < 10s; });
+// ```
+//
+// The schedule refers to the policy rather than copying it, so the policy
+// must outlive it. It is an input range: each pass re-evaluates the policy,
+// so jittered policies yield different delays each time. A default
+// constructed schedule, as views must allow, is empty.
+
+class RetrySchedule
+#if __cplusplus >= 202002L && __has_include(<ranges>)
+    : public std::ranges::view_base
+#endif
+{
+   private:
+    const RetryPolicy* policy_ = nullptr;
+    RetryStatus initial_{};
+
+   public:
+    class iterator
     {
-        RetryStatus status{};
-        std::vector<RetryStatus> xs;
+       private:
+        const RetryPolicy* policy_ = nullptr;
+        std::optional<RetryStatus> status_;
+
+       public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = RetryStatus;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const RetryStatus*;
+        using reference = const RetryStatus&;
+
+        iterator() = default;
+
+        iterator(const RetryPolicy* policy, RetryStatus status)
+            : policy_(policy),
+              status_(policy->apply(status))
+        {
+        }
 
-        for (int i = 0; i < n; i++) {
-            auto new_status = apply(status);
+        reference operator*() const { return *status_; }
+        pointer operator->() const { return &*status_; }
 
-            if (!new_status) {
-                return xs;
-            }
+        iterator& operator++()
+        {
+            status_ = policy_->apply(*status_);
+            return *this;
+        }
 
-            status = *new_status;
-            xs.push_back(status);
+        iterator operator++(int)
+        {
+            auto previous = *this;
+            ++*this;
+            return previous;
         }
 
-        return xs;
+        // Only comparison against the end of the schedule is meaningful
+        friend bool operator==(const iterator& x, const iterator& y)
+        {
+            return x.status_.has_value() == y.status_.has_value();
+        }
+
+        friend bool operator!=(const iterator& x, const iterator& y)
+        {
+            return !(x == y);
+        }
+    };
+
+    RetrySchedule() = default;
+
+    RetrySchedule(const RetryPolicy& policy, RetryStatus status)
+        : policy_(&policy),
+          initial_(status)
+    {
     }
+
+    iterator begin() const { return policy_ ? iterator(policy_, initial_) : end(); }
+    iterator end() const { return iterator(); }
 };
 
+inline RetrySchedule RetryPolicy::schedule(RetryStatus status) const &
+{
+    return RetrySchedule(*this, status);
+}
+
+inline std::vector<RetryStatus> RetryPolicy::simulate(int n) const
+{
+    std::vector<RetryStatus> xs;
+
+    if (n <= 0) {
+        return xs;
+    }
+
+    for (const auto& status : schedule()) {
+        xs.push_back(status);
+
+        if (static_cast<int>(xs.size()) == n) {
+            break;
+        }
+    }
+
+    return xs;
+}
+
 }}  // namespace lt::retry
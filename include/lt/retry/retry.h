@@ -1,5 +1,21 @@
 #pragma once
 
+// The retry policies and the combinators which build on them. The
+// asynchronous machinery (scheduler.h, retry-node.h, pending-pool.h,
+// fan-out.h, quorum.h, pipeline.h, reconnect.h), the classes which own
+// threads or locks (retry-group.h, storm-detector.h), the host integrations
+// (persisted-backoff.h, poll-until.h, pressure.h) and export.h pull in
+// threads, containers and system headers most users do not need, so they
+// are included individually.
+
 #include "lt/retry/retry-policy.h"
 #include "lt/retry/policies.h"
+#include "lt/retry/budget.h"
+#include "lt/retry/idempotency.h"
+#include "lt/retry/lineage.h"
 #include "lt/retry/preemptible.h"
+#include "lt/retry/priority.h"
+#include "lt/retry/rate-limit.h"
+#include "lt/retry/retry-after.h"
+#include "lt/retry/shadow.h"
+#include "lt/retry/success-gate.h"
@@ -0,0 +1,830 @@
+#pragma once
+
+#include "lt/retry/budget.h"
+#include "lt/retry/pending-pool.h"
+#include "lt/retry/priority.h"
+#include "lt/retry/retry-node.h"
+#include "lt/retry/retry-policy.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace lt { namespace retry {
+
+using TenantId = std::uint64_t;
+
+struct TenantConfig
+{
+    // Share of dispatch capacity relative to other tenants
+    int weight = 1;
+
+    // Retries which may be waiting (backing off or due) at once
+    std::size_t max_pending = std::numeric_limits<std::size_t>::max();
+
+    // Retries which may be executing at once
+    std::size_t max_in_flight = std::numeric_limits<std::size_t>::max();
+
+    // Budget which each of the tenant's retries spends `retry_cost` from
+    // when it is scheduled, if set. Whoever sees the tenant's requests
+    // succeed refills it with recordSuccess(), so a tenant whose requests
+    // mostly fail runs out of retries without affecting anyone else.
+    std::shared_ptr<CostBudget> budget;
+    double retry_cost = 1.0;
+};
+
+// Asynchronous retry scheduler shared between many tenants.
+//
+// Retries are scheduled with a delay. Once due they are queued per tenant
+// and dispatched onto the supplied executor, with at most `max_in_flight`
+// executing at once. When dispatch capacity is scarce, due retries are
+// shared out between tenants by deficit round robin: each active tenant
+// receives `weight` dispatches per round, so a tenant stuck in a failure
+// loop cannot starve the others. Each dispatch is O(1) regardless of the
+// number of tenants.
+//
+// Each retry also carries a RetryPriority. Due retries are dispatched in
+// strict priority order, and each priority may only fill its share of
+// `max_in_flight` as given by the PriorityReserve, leaving headroom for the
+// classes above it. Once a priority's share is saturated with due retries
+// already waiting, new retries at that priority are refused outright rather
+// than queued, so low priority sessions give up first under overload.
+//
+// A tenant may also be given its own CostBudget, which bounds its retries
+// relative to its successes rather than to the other tenants.
+//
+// A PendingRetryPool may additionally bound the number of retries waiting
+// across all tenants and the memory they hold; a retry the pool cannot admit
+// is refused immediately, and the pool's pressure() can drive load shedding
+// upstream.
+//
+// ```
+//    RetryScheduler scheduler(executor, 64);
+//    scheduler.configureTenant(tenant, {2, 1000, 16});
+//
+//    scheduler.retry<Result>(tenant, policy, shouldRetry, action,
+//                            [](Result result) { ... });
+// ```
+//
+// No thread is ever blocked on a backoff delay: a single timer thread
+// releases due retries, and the executor only ever runs actions.
+//
+// Pending retries are RetryNodes, linked straight into the scheduler's timer
+// heap and ready lists, so scheduling and cancelling a node never allocates.
+// Callers with their own request structs embed the node in them; retries
+// scheduled as plain Tasks use nodes from a pool owned by the scheduler.
+//
+// The scheduler must outlive the tasks it dispatches; its destructor waits
+// for executing tasks to finish and drops any which are still pending.
+
+class RetryScheduler
+{
+   public:
+    using clock = std::chrono::steady_clock;
+    using Task = std::function<void()>;
+    using Executor = std::function<void(std::function<void()>)>;
+
+   private:
+    struct Tenant;
+
+    // FIFO of ready nodes, linked through the nodes themselves
+    struct NodeQueue
+    {
+        RetryNode* head = nullptr;
+        RetryNode* tail = nullptr;
+
+        bool empty() const { return head == nullptr; }
+
+        void push_back(RetryNode* node)
+        {
+            node->next_ = nullptr;
+            node->prev_ = tail;
+            (tail ? tail->next_ : head) = node;
+            tail = node;
+        }
+
+        RetryNode* pop_front()
+        {
+            auto* node = head;
+            remove(node);
+            return node;
+        }
+
+        void remove(RetryNode* node)
+        {
+            (node->prev_ ? node->prev_->next_ : head) = node->next_;
+            (node->next_ ? node->next_->prev_ : tail) = node->prev_;
+            node->next_ = node->prev_ = nullptr;
+        }
+    };
+
+    // The due retries of one tenant at one priority
+    struct Flow
+    {
+        Tenant* tenant = nullptr;
+        RetryPriority priority = RetryPriority::Interactive;
+        NodeQueue ready;
+        long deficit = 0;
+        bool active = false;
+        Flow* next_active = nullptr;
+    };
+
+    // FIFO of flows with due retries, linked through the flows
+    struct FlowQueue
+    {
+        Flow* head = nullptr;
+        Flow* tail = nullptr;
+
+        bool empty() const { return head == nullptr; }
+
+        Flow* front() const { return head; }
+
+        void push_back(Flow* f)
+        {
+            f->next_active = nullptr;
+            (tail ? tail->next_active : head) = f;
+            tail = f;
+        }
+
+        void pop_front()
+        {
+            head = head->next_active;
+
+            if (!head) {
+                tail = nullptr;
+            }
+        }
+    };
+
+    struct Tenant
+    {
+        TenantConfig config;
+        std::array<Flow, RETRY_PRIORITY_COUNT> flows;
+        std::size_t pending = 0;
+        std::size_t in_flight = 0;
+    };
+
+    // Node for a retry scheduled as a Task, allocated from the scheduler's
+    // node pool
+    struct TaskNode : RetryNode
+    {
+        RetryScheduler* scheduler;
+        Task task;
+
+        TaskNode(RetryScheduler* scheduler_, Task task_)
+            : scheduler(scheduler_),
+              task(std::move(task_))
+        {
+        }
+
+        void fire() override
+        {
+            auto run = std::move(task);
+            scheduler->task_nodes_.destroy(this);
+            run();
+        }
+
+        void drop() override
+        {
+            scheduler->task_nodes_.destroy(this);
+        }
+    };
+
+    Executor executor_;
+    std::size_t max_in_flight_;
+    PriorityReserve reserve_;
+    std::shared_ptr<PendingRetryPool> pool_;
+    std::size_t in_flight_ = 0;
+    std::array<std::size_t, RETRY_PRIORITY_COUNT> ready_ = {};
+    std::uint64_t sequence_ = 0;
+    bool stopping_ = false;
+
+    std::unordered_map<TenantId, Tenant> tenants_;
+    std::array<FlowQueue, RETRY_PRIORITY_COUNT> active_;
+    RetryNodePool<TaskNode> task_nodes_;
+
+    // Root of a pairing heap of waiting nodes, ordered by due time and FIFO
+    // among equal due times. Insertion is O(1) and removing the earliest or
+    // an arbitrary node is amortised O(log n), without any allocation.
+    RetryNode* timers_ = nullptr;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::thread worker_;
+
+    static bool earlier(const RetryNode* a, const RetryNode* b)
+    {
+        if (a->due_ != b->due_) return a->due_ < b->due_;
+        return a->sequence_ < b->sequence_;
+    }
+
+    static RetryNode* meld(RetryNode* a, RetryNode* b)
+    {
+        if (!a) return b;
+        if (!b) return a;
+
+        if (earlier(b, a)) {
+            std::swap(a, b);
+        }
+
+        b->prev_ = a;
+        b->next_ = a->child_;
+
+        if (a->child_) {
+            a->child_->prev_ = b;
+        }
+
+        a->child_ = b;
+        a->next_ = nullptr;
+        a->prev_ = nullptr;
+
+        return a;
+    }
+
+    // Two-pass pairing of a list of siblings into a single heap
+    static RetryNode* mergePairs(RetryNode* first)
+    {
+        RetryNode* pairs = nullptr;
+
+        while (first) {
+            auto* a = first;
+            auto* b = a->next_;
+            first = b ? b->next_ : nullptr;
+
+            a->next_ = a->prev_ = nullptr;
+
+            if (b) {
+                b->next_ = b->prev_ = nullptr;
+                a = meld(a, b);
+            }
+
+            a->next_ = pairs;
+            pairs = a;
+        }
+
+        RetryNode* heap = nullptr;
+
+        while (pairs) {
+            auto* next = pairs->next_;
+            pairs->next_ = nullptr;
+            heap = meld(heap, pairs);
+            pairs = next;
+        }
+
+        return heap;
+    }
+
+    void pushTimer(RetryNode* node)
+    {
+        node->child_ = node->next_ = node->prev_ = nullptr;
+        timers_ = meld(timers_, node);
+    }
+
+    RetryNode* popTimer()
+    {
+        auto* node = timers_;
+        timers_ = mergePairs(node->child_);
+        node->child_ = nullptr;
+
+        return node;
+    }
+
+    void removeTimer(RetryNode* node)
+    {
+        if (node == timers_) {
+            popTimer();
+            return;
+        }
+
+        (node->prev_->child_ == node ? node->prev_->child_ : node->prev_->next_) = node->next_;
+
+        if (node->next_) {
+            node->next_->prev_ = node->prev_;
+        }
+
+        node->next_ = node->prev_ = nullptr;
+        timers_ = meld(timers_, mergePairs(node->child_));
+        node->child_ = nullptr;
+    }
+
+    static Flow& flowOf(RetryNode* node)
+    {
+        return *static_cast<Flow*>(node->flow_);
+    }
+
+    Tenant& tenant(TenantId id)
+    {
+        auto& t = tenants_[id];
+
+        if (!t.flows[0].tenant) {
+            for (std::size_t p = 0; p < RETRY_PRIORITY_COUNT; p++) {
+                t.flows[p].tenant = &t;
+                t.flows[p].priority = static_cast<RetryPriority>(p);
+            }
+        }
+
+        return t;
+    }
+
+    void activate(Flow& f)
+    {
+        if (!f.active && !f.ready.empty() && f.tenant->in_flight < f.tenant->config.max_in_flight) {
+            f.active = true;
+            active_[priorityIndex(f.priority)].push_back(&f);
+        }
+    }
+
+    void activate(Tenant& t)
+    {
+        for (auto& f : t.flows) {
+            activate(f);
+        }
+    }
+
+    void deactivate(Flow& f)
+    {
+        // Idle flows do not bank deficit for later rounds
+        f.active = false;
+        f.deficit = 0;
+        active_[priorityIndex(f.priority)].pop_front();
+    }
+
+    void releaseDue(clock::time_point now)
+    {
+        while (timers_ && timers_->due_ <= now) {
+            auto* node = popTimer();
+            auto& f = flowOf(node);
+
+            node->state_.store(RetryNode::State::Ready, std::memory_order_relaxed);
+            f.ready.push_back(node);
+            ready_[priorityIndex(f.priority)] += 1;
+            activate(f);
+        }
+    }
+
+    // Forget a node which is leaving the scheduler, or is about to fire
+    void unlink(RetryNode* node, RetryNode::State state = RetryNode::State::Idle)
+    {
+        flowOf(node).tenant->pending -= 1;
+        node->state_.store(state, std::memory_order_release);
+
+        if (pool_) {
+            pool_->release(node->bytes_);
+        }
+    }
+
+    // Highest priority class with due retries and room within its share
+    // of the in-flight limit, if any.
+    FlowQueue* nextClass()
+    {
+        for (std::size_t p = 0; p < RETRY_PRIORITY_COUNT; p++) {
+            auto priority = static_cast<RetryPriority>(p);
+
+            if (!active_[p].empty() && in_flight_ < reserve_.limit(max_in_flight_, priority)) {
+                return &active_[p];
+            }
+        }
+
+        return nullptr;
+    }
+
+    // One deficit round robin step: take the next node from the flow at the
+    // head of the chosen priority's active list.
+    bool dispatchOne(std::vector<RetryNode*>& out)
+    {
+        auto* active = nextClass();
+
+        if (!active) {
+            return false;
+        }
+
+        auto& f = *active->front();
+        auto& t = *f.tenant;
+
+        if (t.in_flight >= t.config.max_in_flight || f.ready.empty()) {
+            // The tenant reached its limit through another of its flows, or
+            // the flow's retries were cancelled
+            deactivate(f);
+            return true;
+        }
+
+        if (f.deficit <= 0) {
+            f.deficit += std::max(t.config.weight, 1);
+        }
+
+        auto* node = f.ready.pop_front();
+        unlink(node, RetryNode::State::Dispatched);
+        out.push_back(node);
+        f.deficit -= 1;
+        ready_[priorityIndex(f.priority)] -= 1;
+        t.in_flight += 1;
+        in_flight_ += 1;
+
+        if (f.ready.empty() || t.in_flight >= t.config.max_in_flight) {
+            deactivate(f);
+        } else if (f.deficit <= 0) {
+            active->pop_front();
+            active->push_back(&f);
+        }
+
+        return true;
+    }
+
+    void complete(Tenant& t)
+    {
+        // Notify under the lock: once in_flight_ reaches zero the destructor
+        // may otherwise return before we have finished touching cv_.
+        std::lock_guard<std::mutex> lock(mutex_);
+        in_flight_ -= 1;
+        t.in_flight -= 1;
+        activate(t);
+        cv_.notify_all();
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        std::vector<RetryNode*> dispatched;
+
+        while (!stopping_) {
+            releaseDue(clock::now());
+
+            while (dispatchOne(dispatched)) {
+            }
+
+            if (!dispatched.empty()) {
+                lock.unlock();
+
+                for (auto* node : dispatched) {
+                    // Two pointers fit the executor's std::function without
+                    // a heap allocation. Nothing else touches a dispatched
+                    // node, so its flow is read before it is released to
+                    // fire(), which may reschedule or destroy it.
+                    executor_([this, node]() {
+                        auto* t = flowOf(node).tenant;
+                        node->state_.store(RetryNode::State::Idle, std::memory_order_release);
+                        node->fire();
+                        complete(*t);
+                    });
+                }
+                dispatched.clear();
+
+                lock.lock();
+                continue;
+            }
+
+            if (!timers_) {
+                cv_.wait(lock);
+            } else {
+                cv_.wait_until(lock, timers_->due_);
+            }
+        }
+    }
+
+   public:
+    explicit RetryScheduler(
+        Executor executor,
+        std::size_t max_in_flight = std::numeric_limits<std::size_t>::max(),
+        PriorityReserve reserve = {},
+        std::shared_ptr<PendingRetryPool> pool = nullptr)
+        : executor_(std::move(executor)),
+          max_in_flight_(max_in_flight),
+          reserve_(reserve),
+          pool_(std::move(pool))
+    {
+        worker_ = std::thread([this]() { run(); });
+    }
+
+    RetryScheduler(const RetryScheduler&) = delete;
+    RetryScheduler& operator=(const RetryScheduler&) = delete;
+
+    ~RetryScheduler()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        worker_.join();
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this]() { return in_flight_ == 0; });
+
+        // Retries still pending are dropped along with the scheduler
+        while (timers_) {
+            auto* node = popTimer();
+            unlink(node);
+            node->drop();
+        }
+
+        for (auto& entry : tenants_) {
+            for (auto& f : entry.second.flows) {
+                while (!f.ready.empty()) {
+                    auto* node = f.ready.pop_front();
+                    unlink(node);
+                    node->drop();
+                }
+            }
+        }
+    }
+
+    void configureTenant(TenantId id, TenantConfig config)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto& t = tenant(id);
+            t.config = config;
+            activate(t);
+        }
+        cv_.notify_all();
+    }
+
+    // Fire `node` on the executor once `delay` has elapsed and the tenant's
+    // turn comes round, or say why it was refused without scheduling
+    // anything: the tenant already has `max_pending` retries waiting, the
+    // priority's share of the in-flight limit is full and due retries are
+    // already queued at or above that priority, the pending pool cannot
+    // admit it, or the tenant's budget cannot cover it. `bytes` is the memory the retry holds beyond the node, as
+    // charged against the pool's memory limit. The node must not already be
+    // pending. No memory is allocated, except the first time a tenant is
+    // seen.
+    RetryRejection trySchedule(
+        TenantId id,
+        RetryPriority priority,
+        std::chrono::microseconds delay,
+        RetryNode& node,
+        std::size_t bytes = 0)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto& t = tenant(id);
+            auto rejection = admit(t, priority, sizeof(RetryNode) + bytes);
+
+            if (rejection != RetryRejection::None) {
+                return rejection;
+            }
+
+            enqueue(t, priority, delay, node, sizeof(RetryNode) + bytes);
+        }
+        cv_.notify_all();
+
+        return RetryRejection::None;
+    }
+
+    // As above, running `task`. Its node comes from a pool owned by the
+    // scheduler, so only a task whose captures are too large for
+    // std::function's inline storage allocates.
+    RetryRejection trySchedule(
+        TenantId id,
+        RetryPriority priority,
+        std::chrono::microseconds delay,
+        Task task,
+        std::size_t bytes = 0)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto& t = tenant(id);
+            auto rejection = admit(t, priority, sizeof(TaskNode) + bytes);
+
+            if (rejection != RetryRejection::None) {
+                return rejection;
+            }
+
+            enqueue(t, priority, delay, *task_nodes_.create(this, std::move(task)), sizeof(TaskNode) + bytes);
+        }
+        cv_.notify_all();
+
+        return RetryRejection::None;
+    }
+
+    // Withdraw a pending node before it fires. Returns false if it is not
+    // pending, or has already been dispatched and will fire regardless.
+    bool cancel(RetryNode& node)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        switch (node.state_.load(std::memory_order_relaxed)) {
+            case RetryNode::State::Waiting:
+                removeTimer(&node);
+                break;
+
+            case RetryNode::State::Ready:
+                flowOf(&node).ready.remove(&node);
+                ready_[priorityIndex(flowOf(&node).priority)] -= 1;
+                break;
+
+            case RetryNode::State::Idle:
+            case RetryNode::State::Dispatched:
+                return false;
+        }
+
+        unlink(&node);
+        return true;
+    }
+
+    // As trySchedule(), returning false if the task was refused
+    bool schedule(TenantId id, RetryPriority priority, std::chrono::microseconds delay, Task task)
+    {
+        return trySchedule(id, priority, delay, std::move(task)) == RetryRejection::None;
+    }
+
+    bool schedule(TenantId id, std::chrono::microseconds delay, Task task)
+    {
+        return schedule(id, RetryPriority::Interactive, delay, std::move(task));
+    }
+
+    std::size_t pending(TenantId id) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = tenants_.find(id);
+        return it == tenants_.end() ? 0 : it->second.pending;
+    }
+
+    std::size_t inFlight() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return in_flight_;
+    }
+
+   private:
+    RetryRejection admit(Tenant& t, RetryPriority priority, std::size_t bytes)
+    {
+        if (t.pending >= t.config.max_pending) {
+            return RetryRejection::TenantLimit;
+        }
+
+        if (saturated(priority)) {
+            return RetryRejection::PriorityShed;
+        }
+
+        if (pool_) {
+            auto rejection = pool_->tryAcquire(bytes);
+
+            if (rejection != RetryRejection::None) {
+                return rejection;
+            }
+        }
+
+        // Spent last, as tokens cannot be put back
+        if (t.config.budget && !t.config.budget->trySpend(t.config.retry_cost)) {
+            if (pool_) {
+                pool_->release(bytes);
+            }
+
+            return RetryRejection::TenantBudget;
+        }
+
+        return RetryRejection::None;
+    }
+
+    void enqueue(Tenant& t, RetryPriority priority, std::chrono::microseconds delay, RetryNode& node, std::size_t bytes)
+    {
+        t.pending += 1;
+
+        node.state_.store(RetryNode::State::Waiting, std::memory_order_relaxed);
+        node.due_ = clock::now() + delay;
+        node.sequence_ = sequence_++;
+        node.bytes_ = bytes;
+        node.flow_ = &t.flows[priorityIndex(priority)];
+
+        pushTimer(&node);
+    }
+
+    bool saturated(RetryPriority priority) const
+    {
+        if (in_flight_ < reserve_.limit(max_in_flight_, priority)) {
+            return false;
+        }
+
+        for (std::size_t p = 0; p <= priorityIndex(priority); p++) {
+            if (ready_[p] > 0) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+   public:
+    // Asynchronous counterpart of RetryPolicy::retry(). The first attempt
+    // runs on the calling thread; each retry is scheduled for the tenant
+    // after the policy's delay. `done` receives the final result, either
+    // because `shouldRetry` declined, the policy gave up, or the tenant's
+    // pending limit was reached, the retry was shed for its priority, the
+    // pending pool was full or the tenant's budget ran out; in those cases lastRetryRejection() gives the
+    // reason while `done` runs.
+    template <typename T>
+    void retry(
+        TenantId id,
+        RetryPriority priority,
+        RetryPolicy policy,
+        std::function<bool(RetryStatus, T)> shouldRetry,
+        std::function<T(RetryStatus)> action,
+        std::function<void(T)> done)
+    {
+        // The session is its own node, so each retry is scheduled without
+        // allocating; it keeps itself alive while pending.
+        struct Session : RetryNode
+        {
+            RetryScheduler* scheduler;
+            TenantId tenant;
+            RetryPriority priority;
+            RetryPolicy policy;
+            std::function<bool(RetryStatus, T)> shouldRetry;
+            std::function<T(RetryStatus)> action;
+            std::function<void(T)> done;
+
+            std::shared_ptr<Session> self;
+            RetryStatus next;
+
+            Session(
+                RetryScheduler* scheduler_,
+                TenantId tenant_,
+                RetryPriority priority_,
+                RetryPolicy policy_,
+                std::function<bool(RetryStatus, T)> shouldRetry_,
+                std::function<T(RetryStatus)> action_,
+                std::function<void(T)> done_)
+                : scheduler(scheduler_),
+                  tenant(tenant_),
+                  priority(priority_),
+                  policy(std::move(policy_)),
+                  shouldRetry(std::move(shouldRetry_)),
+                  action(std::move(action_)),
+                  done(std::move(done_))
+            {
+            }
+
+            void fire() override
+            {
+                auto keep = std::move(self);
+                attempt(keep, next);
+            }
+
+            void drop() override
+            {
+                self.reset();
+            }
+
+            static void attempt(const std::shared_ptr<Session>& session, RetryStatus status)
+            {
+                auto result = session->action(status);
+
+                if (!session->shouldRetry(status, result)) {
+                    return finish(session, std::move(result), RetryRejection::None);
+                }
+
+                auto new_status = session->policy.apply(status);
+
+                if (!new_status) {
+                    return finish(session, std::move(result), RetryRejection::None);
+                }
+
+                auto delay = new_status->previous_delay.value_or(std::chrono::microseconds(0));
+
+                session->next = *new_status;
+                session->self = session;
+
+                auto rejection = session->scheduler->trySchedule(session->tenant, session->priority, delay, *session);
+
+                if (rejection != RetryRejection::None) {
+                    session->self.reset();
+                    finish(session, std::move(result), rejection);
+                }
+            }
+
+            static void finish(const std::shared_ptr<Session>& session, T result, RetryRejection rejection)
+            {
+                detail::lastRejection() = rejection;
+                session->done(std::move(result));
+            }
+        };
+
+        auto session = std::make_shared<Session>(
+            this, id, priority, std::move(policy), std::move(shouldRetry), std::move(action), std::move(done));
+
+        Session::attempt(session, RetryStatus{});
+    }
+
+    template <typename T>
+    void retry(
+        TenantId id,
+        RetryPolicy policy,
+        std::function<bool(RetryStatus, T)> shouldRetry,
+        std::function<T(RetryStatus)> action,
+        std::function<void(T)> done)
+    {
+        retry<T>(id, RetryPriority::Interactive, std::move(policy), std::move(shouldRetry), std::move(action), std::move(done));
+    }
+};
+
+}}  // namespace lt::retry
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "lt/retry/retry-policy.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace lt { namespace retry {
+
+// Histogram of delays in power-of-two buckets of microseconds. Bucket 0
+// counts zero delays and bucket i counts delays in [2^(i-1), 2^i) us; the
+// last bucket also collects anything longer. Recording is one relaxed
+// atomic increment.
+class DelayHistogram
+{
+   public:
+    static constexpr std::size_t BUCKETS = 40;
+
+   private:
+    std::array<std::atomic<std::uint64_t>, BUCKETS> buckets_{};
+
+    static std::size_t bucketOf(std::chrono::microseconds delay)
+    {
+        auto us = delay.count();
+
+        if (us <= 0) {
+            return 0;
+        }
+
+        auto v = static_cast<std::uint64_t>(us);
+#if defined(__GNUC__) || defined(__clang__)
+        std::size_t width = 64 - static_cast<std::size_t>(__builtin_clzll(v));
+#else
+        std::size_t width = 0;
+        while (v) {
+            v >>= 1;
+            width++;
+        }
+#endif
+        return width < BUCKETS ? width : BUCKETS - 1;
+    }
+
+   public:
+    void record(std::chrono::microseconds delay)
+    {
+        buckets_[bucketOf(delay)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::uint64_t count(std::size_t bucket) const
+    {
+        return buckets_[bucket].load(std::memory_order_relaxed);
+    }
+
+    // Exclusive upper bound of a bucket
+    static std::chrono::microseconds upperBound(std::size_t bucket)
+    {
+        return std::chrono::microseconds(std::int64_t(1) << bucket);
+    }
+};
+
+// A policy evaluated alongside a site's real policy, whose decisions are
+// recorded but never acted upon.
+class ShadowCandidate
+{
+   private:
+    std::string name_;
+    RetryPolicy policy_;
+
+    DelayHistogram delays_;
+    std::atomic<std::uint64_t> evaluations_{0};
+    std::atomic<std::uint64_t> give_ups_{0};
+    std::atomic<std::uint64_t> gave_up_early_{0};
+    std::atomic<std::uint64_t> retried_longer_{0};
+
+   public:
+    explicit ShadowCandidate(std::string name, RetryPolicy policy)
+        : name_(std::move(name)),
+          policy_(std::move(policy))
+    {
+    }
+
+    ShadowCandidate(const ShadowCandidate&) = delete;
+    ShadowCandidate& operator=(const ShadowCandidate&) = delete;
+
+    void observe(RetryStatus status, std::optional<std::chrono::microseconds> real)
+    {
+        auto delay = policy_(status);
+
+        evaluations_.fetch_add(1, std::memory_order_relaxed);
+
+        if (delay) {
+            delays_.record(*delay);
+
+            if (!real) {
+                retried_longer_.fetch_add(1, std::memory_order_relaxed);
+            }
+        } else {
+            give_ups_.fetch_add(1, std::memory_order_relaxed);
+
+            if (real) {
+                gave_up_early_.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    const std::string& name() const { return name_; }
+
+    // Delays the candidate would have slept for
+    const DelayHistogram& delays() const { return delays_; }
+
+    std::uint64_t evaluations() const { return evaluations_.load(std::memory_order_relaxed); }
+
+    // Decisions where the candidate would have stopped retrying
+    std::uint64_t giveUps() const { return give_ups_.load(std::memory_order_relaxed); }
+
+    // Decisions where the candidate would have stopped but the real policy retried
+    std::uint64_t gaveUpEarly() const { return gave_up_early_.load(std::memory_order_relaxed); }
+
+    // Decisions where the candidate would have retried but the real policy stopped
+    std::uint64_t retriedLonger() const { return retried_longer_.load(std::memory_order_relaxed); }
+};
+
+//
+// Run `real` as normal, and additionally evaluate each candidate against the
+// same stream of statuses, so that proposed policies can be compared with
+// production behaviour before they are switched on:
+//
+//     auto candidate = std::make_shared<ShadowCandidate>(
+//         "equal-jitter", capDelay(1s, equalJitterBackoff(10ms)) + limitRetries(5));
+//
+//     auto policy = shadow(capDelay(1s, fullJitterBackoff(10ms)) + limitRetries(5), {candidate});
+//
+// Candidates only see the statuses produced by the real policy: their
+// decisions are judged one step at a time, not as independent trajectories.
+//
+inline RetryPolicy shadow(RetryPolicy real, std::vector<std::shared_ptr<ShadowCandidate>> candidates)
+{
+    return RetryPolicy([=](RetryStatus status) -> std::optional<std::chrono::microseconds> {
+        auto delay = real(status);
+
+        for (const auto& candidate : candidates) {
+            candidate->observe(status, delay);
+        }
+
+        return delay;
+    });
+}
+
+}}  // namespace lt::retry
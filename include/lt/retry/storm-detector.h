@@ -0,0 +1,274 @@
+#pragma once
+
+#include "lt/retry/retry-policy.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace lt { namespace retry {
+
+struct StormConfig
+{
+    // Number of evaluations making up the sliding window
+    std::size_t window = 10;
+
+    // Enter degraded mode once retries per first attempt reach this ratio
+    double enter_ratio = 0.5;
+
+    // Leave degraded mode once the ratio has fallen back to this
+    double exit_ratio = 0.1;
+
+    // Don't enter degraded mode on a window with fewer first attempts than
+    // this; such a window can still end degraded mode
+    std::uint64_t min_first_attempts = 100;
+};
+
+// Process-wide detector of retry storms.
+//
+// Every retry site records its attempts; the detector compares the number
+// of retries with the number of first attempts over a sliding window of
+// evaluations. When retries amplify the offered load by `enter_ratio` or
+// more, the detector switches to degraded mode, which sites observe through
+// degradeOnRetryStorm(). It switches back only once the ratio has fallen to
+// `exit_ratio`, so it does not flap around a single threshold. A quiet
+// window is too small to start a storm, but is judged for the exit, so the
+// detector recovers even when degraded mode has shed most of the traffic.
+//
+// ```
+//    auto& detector = RetryStormDetector::global();
+//    detector.start(std::chrono::seconds(1));
+//
+//    auto policy = degradeOnRetryStorm(
+//        capDelay(1s, fullJitterBackoff(10ms)) + limitRetries(5),
+//        capDelay(10s, fullJitterBackoff(100ms)) + limitRetries(1));
+//
+//    auto action = [&](RetryStatus status) -> Result {
+//        detector.recordAttempt(status);
+//        ...
+//    };
+// ```
+//
+// Recording is a relaxed increment of a counter owned by the calling thread;
+// the counters are only summed when the window is evaluated, off the hot
+// path.
+
+class RetryStormDetector
+{
+   private:
+    struct alignas(64) Counters
+    {
+        std::atomic<std::uint64_t> first_attempts{0};
+        std::atomic<std::uint64_t> retries{0};
+    };
+
+    struct Sample
+    {
+        std::uint64_t first_attempts;
+        std::uint64_t retries;
+    };
+
+    // Owned only by the detector; threads' cached counters hold weak
+    // references to it, so they can tell once the detector is gone
+    std::shared_ptr<char> alive_ = std::make_shared<char>();
+
+    StormConfig config_;
+    std::atomic<bool> degraded_{false};
+    std::atomic<double> ratio_{0.0};
+
+    std::mutex mutex_;
+    std::vector<std::shared_ptr<Counters>> counters_;
+    Sample retired_{0, 0};
+    Sample last_total_{0, 0};
+    std::vector<Sample> samples_;
+    std::size_t next_sample_ = 0;
+
+    std::condition_variable cv_;
+    bool stopping_ = false;
+    std::thread evaluator_;
+
+    Counters& local()
+    {
+        // Detectors are identified by their liveness token rather than their
+        // address: the token's control block outlives every weak reference
+        // to it, so a new detector never picks up stale counters.
+        static thread_local std::vector<std::pair<std::weak_ptr<void>, std::shared_ptr<Counters>>> cache;
+
+        for (auto& entry : cache) {
+            if (!entry.first.owner_before(alive_) && !alive_.owner_before(entry.first)) {
+                return *entry.second;
+            }
+        }
+
+        // Forget the counters of detectors which have been destroyed
+        cache.erase(
+            std::remove_if(cache.begin(), cache.end(), [](const auto& entry) { return entry.first.expired(); }),
+            cache.end());
+
+        auto counters = std::make_shared<Counters>();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            counters_.push_back(counters);
+        }
+        cache.emplace_back(alive_, counters);
+
+        return *counters;
+    }
+
+    static void increment(std::atomic<std::uint64_t>& counter)
+    {
+        // Only the owning thread writes, so no read-modify-write is needed
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    // Sum all counters, folding those of exited threads into retired_
+    Sample total()
+    {
+        Sample sum = retired_;
+
+        for (auto& c : counters_) {
+            sum.first_attempts += c->first_attempts.load(std::memory_order_relaxed);
+            sum.retries += c->retries.load(std::memory_order_relaxed);
+        }
+
+        auto exited = std::remove_if(counters_.begin(), counters_.end(), [this](const std::shared_ptr<Counters>& c) {
+            if (c.use_count() > 1) return false;
+            retired_.first_attempts += c->first_attempts.load(std::memory_order_relaxed);
+            retired_.retries += c->retries.load(std::memory_order_relaxed);
+            return true;
+        });
+        counters_.erase(exited, counters_.end());
+
+        return sum;
+    }
+
+   public:
+    explicit RetryStormDetector(StormConfig config = {})
+        : config_(config),
+          samples_(std::max<std::size_t>(config.window, 1), Sample{0, 0})
+    {
+    }
+
+    RetryStormDetector(const RetryStormDetector&) = delete;
+    RetryStormDetector& operator=(const RetryStormDetector&) = delete;
+
+    ~RetryStormDetector()
+    {
+        stop();
+    }
+
+    static RetryStormDetector& global()
+    {
+        static RetryStormDetector detector;
+        return detector;
+    }
+
+    // Record an attempt by a retry site: a first attempt if the status is
+    // fresh, otherwise a retry.
+    void recordAttempt(const RetryStatus& status)
+    {
+        auto& c = local();
+        increment(status.iteration_number == 0 ? c.first_attempts : c.retries);
+    }
+
+    bool degraded() const
+    {
+        return degraded_.load(std::memory_order_relaxed);
+    }
+
+    // Retries per first attempt over the last window
+    double ratio() const
+    {
+        return ratio_.load(std::memory_order_relaxed);
+    }
+
+    // Close the current interval and re-evaluate the window. Called
+    // periodically by the evaluator thread after start(), or by the
+    // application's own timer.
+    void evaluate()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto now = total();
+        samples_[next_sample_] = Sample{
+            now.first_attempts - last_total_.first_attempts,
+            now.retries - last_total_.retries};
+        next_sample_ = (next_sample_ + 1) % samples_.size();
+        last_total_ = now;
+
+        Sample window{0, 0};
+        for (auto& s : samples_) {
+            window.first_attempts += s.first_attempts;
+            window.retries += s.retries;
+        }
+
+        auto ratio = static_cast<double>(window.retries) /
+                     static_cast<double>(std::max<std::uint64_t>(window.first_attempts, 1));
+        ratio_.store(ratio, std::memory_order_relaxed);
+
+        bool quiet = window.first_attempts < config_.min_first_attempts;
+
+        if (!degraded_.load(std::memory_order_relaxed) && !quiet && ratio >= config_.enter_ratio) {
+            degraded_.store(true, std::memory_order_relaxed);
+        } else if (degraded_.load(std::memory_order_relaxed) && ratio <= config_.exit_ratio) {
+            degraded_.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    void start(std::chrono::milliseconds interval)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (evaluator_.joinable()) {
+            return;
+        }
+
+        stopping_ = false;
+        evaluator_ = std::thread([this, interval]() {
+            std::unique_lock<std::mutex> lock(mutex_);
+
+            while (!cv_.wait_for(lock, interval, [this]() { return stopping_; })) {
+                lock.unlock();
+                evaluate();
+                lock.lock();
+            }
+        });
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+
+        if (evaluator_.joinable()) {
+            evaluator_.join();
+        }
+    }
+};
+
+//
+// Use `normal` while the detector reports no retry storm and `degraded`
+// while it does, eg. fewer retries with longer delays, or neverRetry() for
+// low priority sites.
+//
+inline RetryPolicy degradeOnRetryStorm(
+    RetryPolicy normal,
+    RetryPolicy degraded,
+    RetryStormDetector& detector = RetryStormDetector::global())
+{
+    return RetryPolicy([=, &detector](RetryStatus status) -> std::optional<std::chrono::microseconds> {
+        return detector.degraded() ? degraded(status) : normal(status);
+    });
+}
+
+}}  // namespace lt::retry
@@ -0,0 +1,265 @@
+#pragma once
+
+#include "lt/retry/retry-policy.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace lt { namespace retry {
+
+// Online table of how often a retry succeeds, by the class of the error
+// which caused it and by attempt number, for one retry site.
+//
+// Entry (c, n) counts attempts numbered n (the nth retry, so n >= 1) which
+// followed a failure of class c, and how many of them succeeded. Attempt
+// numbers beyond `max_attempts` share the last entry. Recording is two
+// relaxed atomic increments, and the table is a flat array of counters.
+//
+// Counts age out: once an entry has seen `horizon` attempts both of its
+// counts are halved, so it reflects roughly the last `horizon` outcomes and
+// can follow a backend which recovers. (The halving may race with
+// concurrent increments and lose a few of them.)
+//
+// `snapshot()` exports the table, eg. to trim static limitRetries() values
+// offline; `suggestRetryLimit()` does so directly.
+
+class SuccessTable
+{
+   public:
+    struct Row
+    {
+        std::size_t error_class;
+        int attempt;
+        std::uint64_t attempts;
+        std::uint64_t successes;
+    };
+
+   private:
+    std::size_t error_classes_;
+    int max_attempts_;
+    std::uint64_t horizon_;
+    std::vector<std::atomic<std::uint64_t>> attempts_;
+    std::vector<std::atomic<std::uint64_t>> successes_;
+
+    std::size_t index(std::size_t error_class, int attempt) const
+    {
+        auto c = std::min(error_class, error_classes_ - 1);
+        auto n = std::min(std::max(attempt, 1), max_attempts_) - 1;
+
+        return c * static_cast<std::size_t>(max_attempts_) + static_cast<std::size_t>(n);
+    }
+
+   public:
+    explicit SuccessTable(std::size_t error_classes, int max_attempts = 16, std::uint64_t horizon = 1024)
+        : error_classes_(std::max<std::size_t>(error_classes, 1)),
+          max_attempts_(std::max(max_attempts, 1)),
+          horizon_(std::max<std::uint64_t>(horizon, 2)),
+          attempts_(error_classes_ * static_cast<std::size_t>(max_attempts_)),
+          successes_(error_classes_ * static_cast<std::size_t>(max_attempts_))
+    {
+    }
+
+    SuccessTable(const SuccessTable&) = delete;
+    SuccessTable& operator=(const SuccessTable&) = delete;
+
+    // Record the outcome of retry `attempt`, made after a failure of
+    // `error_class`
+    void record(std::size_t error_class, int attempt, bool success)
+    {
+        auto i = index(error_class, attempt);
+        auto n = attempts_[i].fetch_add(1, std::memory_order_relaxed) + 1;
+
+        if (success) {
+            successes_[i].fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // Only the thread which takes the count to the horizon halves it
+        if (n == horizon_) {
+            attempts_[i].fetch_sub(horizon_ - horizon_ / 2, std::memory_order_relaxed);
+            successes_[i].store(successes_[i].load(std::memory_order_relaxed) / 2, std::memory_order_relaxed);
+        }
+    }
+
+    // Observed probability that retry `attempt` after a failure of
+    // `error_class` succeeds, once at least `min_samples` have been seen.
+    // Aging leaves an entry with about `horizon / 2` attempts, so a larger
+    // `min_samples` is capped at that; otherwise an entry which had enough
+    // samples would become unknown again every time it aged.
+    std::optional<double> probability(std::size_t error_class, int attempt, std::uint64_t min_samples) const
+    {
+        auto i = index(error_class, attempt);
+        auto n = attempts_[i].load(std::memory_order_relaxed);
+
+        if (n == 0 || n < std::min(min_samples, horizon_ / 2)) {
+            return std::nullopt;
+        }
+
+        auto successes = std::min(successes_[i].load(std::memory_order_relaxed), n);
+        return static_cast<double>(successes) / static_cast<double>(n);
+    }
+
+    std::vector<Row> snapshot() const
+    {
+        std::vector<Row> rows;
+        rows.reserve(attempts_.size());
+
+        for (std::size_t c = 0; c < error_classes_; c++) {
+            for (int n = 1; n <= max_attempts_; n++) {
+                auto i = index(c, n);
+                rows.push_back(Row{
+                    c, n,
+                    attempts_[i].load(std::memory_order_relaxed),
+                    successes_[i].load(std::memory_order_relaxed)});
+            }
+        }
+
+        return rows;
+    }
+
+    // The number of retries worth making after a failure of `error_class`:
+    // retries up to the first whose observed success probability is below
+    // `threshold`. Attempts without enough samples are assumed worthwhile.
+    int suggestRetryLimit(std::size_t error_class, double threshold, std::uint64_t min_samples) const
+    {
+        for (int n = 1; n <= max_attempts_; n++) {
+            auto p = probability(error_class, n, min_samples);
+
+            if (p && *p < threshold) {
+                return n - 1;
+            }
+        }
+
+        return max_attempts_;
+    }
+};
+
+namespace detail {
+
+// Whether to let a retry through a closed gate, with probability `explore`
+inline bool exploreGate(double explore)
+{
+    // xorshift64*; quality is unimportant here
+    static thread_local std::uint64_t state =
+        0x9e3779b97f4a7c15ull ^ reinterpret_cast<std::uintptr_t>(&state);
+
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+
+    return static_cast<double>((state * 0x2545f4914f6cdd1dull) >> 11) * 0x1.0p-53 < explore;
+}
+
+}  // namespace detail
+
+// Retry an action while the next retry is likely enough to succeed.
+//
+// The action's result is classified: `classify` returns std::nullopt for a
+// success, or the class of the error. Every retry's outcome is recorded in
+// the table, and before each retry the observed probability that it
+// succeeds, given the class of the error just seen and its attempt number,
+// is compared with `threshold`. Below it, the session gives up as though
+// the policy had, except for a fraction `explore` of such retries which
+// are let through anyway, so that a closed entry keeps receiving samples
+// and reopens once retries start succeeding again.
+//
+// ```
+//    auto table = std::make_shared<SuccessTable>(ERROR_CLASS_COUNT);
+//    auto gated = SuccessGatedRetry(policy, table, 0.01);
+//
+//    gated.retry<Result>(classify, shouldRetry, action);
+// ```
+
+class SuccessGatedRetry
+{
+   private:
+    RetryPolicy policy_;
+    std::shared_ptr<SuccessTable> table_;
+    double threshold_;
+    std::uint64_t min_samples_;
+    double explore_;
+
+   public:
+    explicit SuccessGatedRetry(
+        RetryPolicy policy,
+        std::shared_ptr<SuccessTable> table,
+        double threshold,
+        std::uint64_t min_samples = 100,
+        double explore = 0.01)
+        : policy_(std::move(policy)),
+          table_(std::move(table)),
+          threshold_(threshold),
+          min_samples_(min_samples),
+          explore_(explore)
+    {
+    }
+
+    template <typename T>
+    T retry(
+        std::function<std::optional<std::size_t>(T)> classify,
+        std::function<bool(RetryStatus, T)> shouldRetry,
+        std::function<T(RetryStatus)> action) const
+    {
+        RetryStatus status{};
+        std::optional<std::size_t> previous_error;
+
+        while (true) {
+            auto result = action(status);
+            auto error = classify(result);
+
+            if (previous_error) {
+                table_->record(*previous_error, status.iteration_number, !error);
+            }
+
+            if (!shouldRetry(status, result) || !error) {
+                return result;
+            }
+
+            auto p = table_->probability(*error, status.iteration_number + 1, min_samples_);
+
+            if (p && *p < threshold_ && !detail::exploreGate(explore_)) {
+                return result;
+            }
+
+            auto new_status = policy_.applyAndDelay(status);
+
+            if (!new_status) {
+                return result;
+            }
+
+            status = *new_status;
+            previous_error = error;
+        }
+    }
+};
+
+//
+// Stop retrying once the observed probability that the next retry succeeds
+// falls below `threshold`, for a site whose failures are all of one
+// `error_class`. The site records outcomes in the table itself. As with
+// SuccessGatedRetry, a fraction `explore` of gated retries go ahead.
+//
+inline RetryPolicy gateBySuccessProbability(
+    std::shared_ptr<SuccessTable> table,
+    std::size_t error_class,
+    double threshold,
+    RetryPolicy policy,
+    std::uint64_t min_samples = 100,
+    double explore = 0.01)
+{
+    return RetryPolicy([=](RetryStatus status) -> std::optional<std::chrono::microseconds> {
+        auto p = table->probability(error_class, status.iteration_number + 1, min_samples);
+
+        if (p && *p < threshold && !detail::exploreGate(explore)) {
+            return std::nullopt;
+        }
+
+        return policy(status);
+    });
+}
+
+}}  // namespace lt::retry
@@ -0,0 +1,11 @@
+// Out-of-line definitions of the combinators for the retry-compiled
+// library target. See lt/retry/config.h.
+
+#ifndef LT_RETRY_SEPARATE_COMPILATION
+#define LT_RETRY_SEPARATE_COMPILATION
+#endif
+
+#define LT_RETRY_SOURCE
+
+#include "lt/retry/idempotency.h"
+#include "lt/retry/policies.h"
@@ -0,0 +1,169 @@
+// C++20 module interface for lt::retry.
+//
+//     import lt.retry;
+//
+// The module wraps the headers rather than replacing them, so the header-only
+// library and the module can be used side by side while code migrates. See
+// the LT_RETRY_BUILD_MODULE option in CMakeLists.txt.
+
+module;
+
+#include "lt/retry/retry.h"
+#include "lt/retry/export.h"
+#include "lt/retry/fan-out.h"
+#include "lt/retry/pending-pool.h"
+#include "lt/retry/persisted-backoff.h"
+#include "lt/retry/pipeline.h"
+#include "lt/retry/poll-until.h"
+#include "lt/retry/pressure.h"
+#include "lt/retry/quorum.h"
+#include "lt/retry/reconnect.h"
+#include "lt/retry/retry-group.h"
+#include "lt/retry/retry-node.h"
+#include "lt/retry/scheduler.h"
+#include "lt/retry/storm-detector.h"
+
+export module lt.retry;
+
+export namespace lt::retry {
+
+// retry-policy.h
+using lt::retry::RetryStatus;
+using lt::retry::RETRY_STATUS_FORMAT_MAX;
+using lt::retry::formatTo;
+using lt::retry::operator<<;
+using lt::retry::RetryPolicy;
+using lt::retry::RetrySchedule;
+
+// policies.h
+using lt::retry::backoffDelay;
+using lt::retry::fullJitterDelay;
+using lt::retry::equalJitterDelay;
+using lt::retry::neverRetry;
+using lt::retry::limitRetries;
+using lt::retry::limitCumulativeDelay;
+using lt::retry::limitTimePoint;
+using lt::retry::limitRetriesByDelay;
+using lt::retry::constantDelay;
+using lt::retry::fullJitter;
+using lt::retry::equalJitter;
+using lt::retry::exponentialBackoff;
+using lt::retry::fullJitterBackoff;
+using lt::retry::equalJitterBackoff;
+using lt::retry::decorrelatedJitterBackoff;
+using lt::retry::capDelay;
+using lt::retry::slottedBackoff;
+
+// budget.h
+using lt::retry::CostBudget;
+using lt::retry::limitByCost;
+
+// export.h
+using lt::retry::ColumnarSimulationWriter;
+using lt::retry::CsvSimulationWriter;
+using lt::retry::simulateTo;
+
+// fan-out.h
+using lt::retry::FanOutConfig;
+using lt::retry::retryAll;
+
+// idempotency.h
+using lt::retry::IdempotentRetryStatus;
+using lt::retry::newIdempotencyKey;
+using lt::retry::IdempotentRetry;
+using lt::retry::IdempotencyCache;
+
+// lineage.h
+using lt::retry::AttemptLineage;
+using lt::retry::LineageScope;
+using lt::retry::limitAmplification;
+using lt::retry::retryWithLineage;
+
+// pending-pool.h
+using lt::retry::RetryRejection;
+using lt::retry::lastRetryRejection;
+using lt::retry::PendingRetryPool;
+
+// persisted-backoff.h
+#if defined(__unix__) || defined(__APPLE__)
+using lt::retry::BackoffStateFile;
+using lt::retry::persistBackoff;
+using lt::retry::awaitResume;
+#endif
+
+// pipeline.h
+using lt::retry::RetryingStageConfig;
+using lt::retry::RetryingStage;
+
+// poll-until.h
+using lt::retry::ReadinessSource;
+#ifdef __linux__
+using lt::retry::FdReadiness;
+using lt::retry::FutexReadiness;
+#endif
+using lt::retry::pollUntil;
+
+// preemptible.h
+using lt::retry::PreemptibleRetryStatus;
+using lt::retry::PreemptibleRetry;
+
+// pressure.h
+using lt::retry::HostPressure;
+using lt::retry::PressureSampler;
+using lt::retry::PressureThresholds;
+using lt::retry::backoffOnHostPressure;
+
+// priority.h
+using lt::retry::RetryPriority;
+using lt::retry::RETRY_PRIORITY_COUNT;
+using lt::retry::priorityIndex;
+using lt::retry::PriorityReserve;
+
+// quorum.h
+using lt::retry::QuorumResult;
+using lt::retry::retryQuorum;
+
+// rate-limit.h
+using lt::retry::SlidingWindowRateLimiter;
+using lt::retry::limitRetryRate;
+using lt::retry::throttleRetryRate;
+
+// reconnect.h
+using lt::retry::ConnectionId;
+using lt::retry::ReconnectConfig;
+using lt::retry::ReconnectManager;
+
+// retry-after.h
+using lt::retry::QueueDepthEstimator;
+using lt::retry::RetryAfterConfig;
+using lt::retry::RetryAfterAdvisor;
+
+// retry-group.h
+using lt::retry::RetryGroupLimits;
+using lt::retry::RetryGroup;
+
+// retry-node.h
+using lt::retry::RetryNode;
+using lt::retry::RetryNodePool;
+
+// scheduler.h
+using lt::retry::TenantId;
+using lt::retry::TenantConfig;
+using lt::retry::RetryScheduler;
+
+// shadow.h
+using lt::retry::DelayHistogram;
+using lt::retry::ShadowCandidate;
+using lt::retry::shadow;
+
+// storm-detector.h
+using lt::retry::StormConfig;
+using lt::retry::RetryStormDetector;
+using lt::retry::degradeOnRetryStorm;
+
+// success-gate.h
+using lt::retry::SuccessTable;
+using lt::retry::SuccessGatedRetry;
+using lt::retry::gateBySuccessProbability;
+
+}  // namespace lt::retry
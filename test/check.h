@@ -0,0 +1,35 @@
+#pragma once
+
+// Minimal checks for the behaviour tests: each test is a plain executable
+// which reports failed checks on stderr and exits non-zero if any failed.
+
+#include <cstdio>
+#include <cstdlib>
+
+namespace lt { namespace retry { namespace test {
+
+inline int& failures()
+{
+    static int count = 0;
+    return count;
+}
+
+inline int finish()
+{
+    if (failures() > 0) {
+        std::fprintf(stderr, "%d check(s) failed\n", failures());
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+}}}  // namespace lt::retry::test
+
+#define CHECK(condition)                                                                  \
+    do {                                                                                  \
+        if (!(condition)) {                                                               \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            ::lt::retry::test::failures() += 1;                                          \
+        }                                                                                 \
+    } while (0)
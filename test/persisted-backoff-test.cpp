@@ -0,0 +1,132 @@
+#include "lt/retry/policies.h"
+#include "lt/retry/persisted-backoff.h"
+
+#include "check.h"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace lt::retry;
+using namespace std::chrono_literals;
+
+static const std::size_t SLOTS = 64;
+
+static std::string statePath()
+{
+    return "/tmp/lt-retry-test-" + std::to_string(::getpid()) + ".state";
+}
+
+// Sequence numbers of the slots, read straight from the file
+static std::uint64_t sequenceOf(const std::string& path, std::size_t i)
+{
+    std::uint64_t sequence = 0;
+    int fd = ::open(path.c_str(), O_RDONLY);
+    (void)!::pread(fd, &sequence, sizeof(sequence), static_cast<off_t>(64 + i * 64));
+    ::close(fd);
+    return sequence;
+}
+
+// Leave every odd slot as if its writer had crashed mid-update
+static void wedgeOddSlots(const std::string& path)
+{
+    int fd = ::open(path.c_str(), O_WRONLY);
+
+    for (std::size_t i = 1; i < SLOTS; i += 2) {
+        std::uint64_t sequence = 7;
+        (void)!::pwrite(fd, &sequence, sizeof(sequence), static_cast<off_t>(64 + i * 64));
+    }
+
+    ::close(fd);
+}
+
+static void roundTrip(const std::string& path)
+{
+    auto file = std::make_shared<BackoffStateFile>(path, SLOTS);
+
+    CHECK(!file->load("db"));
+    CHECK(file->untilResume("db") == 0us);
+
+    file->store("db", RetryStatus{3, 30ms, std::chrono::microseconds(20ms)});
+
+    auto status = file->load("db");
+    CHECK(status && status->iteration_number == 3);
+    CHECK(status && status->cumulative_delay == 30ms);
+    CHECK(status && status->previous_delay == std::chrono::microseconds(20ms));
+    CHECK(file->untilResume("db") > 0us && file->untilResume("db") <= 20ms);
+
+    auto started = std::chrono::steady_clock::now();
+    awaitResume(*file, "db");
+    CHECK(std::chrono::steady_clock::now() - started >= 10ms);
+
+    // A fresh session resumes from the stored iteration
+    auto policy = persistBackoff(file, "db", RetryPolicy([](RetryStatus s) -> std::optional<std::chrono::microseconds> {
+        return std::chrono::milliseconds(s.iteration_number);
+    }));
+
+    CHECK(policy(RetryStatus{}) == std::chrono::microseconds(3ms));
+    CHECK(file->load("db") && file->load("db")->iteration_number == 4);
+
+    file->reset("db");
+    CHECK(!file->load("db"));
+}
+
+static void layoutMismatch(const std::string& path)
+{
+    BackoffStateFile file(path, SLOTS);
+    bool threw = false;
+
+    try {
+        BackoffStateFile other(path, SLOTS * 2);
+    } catch (const std::system_error& e) {
+        threw = e.code().value() == EINVAL;
+    }
+
+    CHECK(threw);
+}
+
+static void recovery(const std::string& path)
+{
+    {
+        BackoffStateFile first(path, SLOTS);
+        wedgeOddSlots(path);
+
+        // Another process has the file open, so the wedged slots may belong
+        // to a live writer and are left alone, but stores pass them over
+        BackoffStateFile second(path, SLOTS);
+        CHECK(sequenceOf(path, 1) == 7);
+
+        for (char c = 'a'; c <= 'p'; c++) {
+            std::string endpoint(1, c);
+            second.store(endpoint, RetryStatus{1, 1ms, std::chrono::microseconds(1ms)});
+            CHECK(second.load(endpoint).has_value());
+        }
+    }
+
+    // The sole opener clears them, keeping the entries stored around them
+    BackoffStateFile file(path, SLOTS);
+
+    for (std::size_t i = 1; i < SLOTS; i += 2) {
+        CHECK(!(sequenceOf(path, i) & 1));
+    }
+
+    CHECK(file.load("a").has_value());
+}
+
+int main()
+{
+    auto path = statePath();
+
+    ::unlink(path.c_str());
+    roundTrip(path);
+    layoutMismatch(path);
+    recovery(path);
+    ::unlink(path.c_str());
+
+    return lt::retry::test::finish();
+}
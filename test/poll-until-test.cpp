@@ -0,0 +1,117 @@
+#include "lt/retry/policies.h"
+#include "lt/retry/poll-until.h"
+
+#include "check.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+using namespace lt::retry;
+using namespace std::chrono;
+
+static void withoutSource()
+{
+    int checks = 0;
+    CHECK(pollUntil(constantDelay(microseconds(100)) + limitRetries(10), [&](RetryStatus) { return ++checks == 3; }));
+    CHECK(checks == 3);
+
+    checks = 0;
+    CHECK(!pollUntil(constantDelay(microseconds(100)) + limitRetries(2), [&](RetryStatus) { return ++checks < 0; }));
+    CHECK(checks == 3);
+}
+
+#ifdef __linux__
+
+// Counts how often the poller waits on a source
+struct CountingReadiness : ReadinessSource
+{
+    ReadinessSource& inner;
+    int waits = 0;
+
+    explicit CountingReadiness(ReadinessSource& inner_) : inner(inner_) {}
+
+    bool wait(microseconds timeout) override
+    {
+        waits += 1;
+        return inner.wait(timeout);
+    }
+
+    bool closed() const override { return inner.closed(); }
+};
+
+// A change reported through the source is noticed long before the interval
+static void eventfdWakesPoller()
+{
+    int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    FdReadiness ready(fd);
+    std::atomic<bool> flag{false};
+
+    std::thread notifier([&]() {
+        std::this_thread::sleep_for(milliseconds(20));
+        flag = true;
+        std::uint64_t one = 1;
+        (void)!::write(fd, &one, sizeof(one));
+    });
+
+    auto start = steady_clock::now();
+    CHECK(pollUntil(constantDelay(seconds(10)) + limitRetries(1), [&](RetryStatus) { return flag.load(); }, &ready));
+    CHECK(steady_clock::now() - start < seconds(5));
+
+    notifier.join();
+    ::close(fd);
+}
+
+// A pipe whose writer has gone reports POLLHUP forever; the poller must
+// fall back to the interval rather than spin
+static void closedPipeDoesNotSpin()
+{
+    int fds[2];
+    CHECK(::pipe(fds) == 0);
+    ::close(fds[1]);
+
+    FdReadiness fd(fds[0]);
+    CountingReadiness ready(fd);
+    int checks = 0;
+
+    CHECK(!pollUntil(constantDelay(milliseconds(20)) + limitRetries(3), [&](RetryStatus) { return ++checks < 0; }, &ready));
+    CHECK(fd.closed());
+    CHECK(checks == 4);
+    CHECK(ready.waits <= 3);
+
+    ::close(fds[0]);
+}
+
+// A level-triggered descriptor which is never drained keeps reporting
+// readiness; early checks are rate limited
+static void undrainedSourceIsRateLimited()
+{
+    int fd = ::eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC);
+    FdReadiness ready(fd, false);
+    int checks = 0;
+
+    CHECK(!pollUntil(constantDelay(milliseconds(50)) + limitRetries(1), [&](RetryStatus) { return ++checks < 0; }, &ready));
+    CHECK(checks <= 60);
+
+    ::close(fd);
+}
+
+#endif
+
+int main()
+{
+    withoutSource();
+
+#ifdef __linux__
+    eventfdWakesPoller();
+    closedPipeDoesNotSpin();
+    undrainedSourceIsRateLimited();
+#endif
+
+    return lt::retry::test::finish();
+}
@@ -0,0 +1,82 @@
+#include "lt/retry/policies.h"
+#include "lt/retry/priority.h"
+#include "lt/retry/scheduler.h"
+
+#include "check.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+using namespace lt::retry;
+
+static void reserveLimits()
+{
+    PriorityReserve reserve;
+
+    CHECK(reserve.limit(0, RetryPriority::Critical) == 0);
+    CHECK(reserve.limit(0, RetryPriority::Batch) == 0);
+
+    // Small capacities still leave every class room for one
+    for (std::size_t capacity : {1, 2}) {
+        CHECK(reserve.limit(capacity, RetryPriority::Critical) == capacity);
+        CHECK(reserve.limit(capacity, RetryPriority::Interactive) >= 1);
+        CHECK(reserve.limit(capacity, RetryPriority::Batch) >= 1);
+    }
+
+    CHECK(reserve.limit(10, RetryPriority::Interactive) == 9);
+    CHECK(reserve.limit(10, RetryPriority::Batch) == 7);
+
+    PriorityReserve closed;
+    closed.reserved = {{0.0, 0.0, 1.0}};
+    CHECK(closed.limit(1, RetryPriority::Batch) == 0);
+}
+
+// A scheduler whose in-flight limit is smaller than the reserve rounds to
+// must still run tasks of every priority
+static void schedulerWithSmallCapacity(std::size_t capacity)
+{
+    std::mutex mutex;
+    std::condition_variable cv;
+    int ran = 0;
+
+    RetryScheduler scheduler([](std::function<void()> task) { std::thread(std::move(task)).detach(); }, capacity);
+
+    for (auto priority : {RetryPriority::Critical, RetryPriority::Interactive, RetryPriority::Batch}) {
+        CHECK(scheduler.schedule(1, priority, std::chrono::microseconds(0), [&]() {
+            std::lock_guard<std::mutex> lock(mutex);
+            ran += 1;
+            cv.notify_all();
+        }));
+
+        std::unique_lock<std::mutex> lock(mutex);
+        auto done = cv.wait_for(lock, std::chrono::seconds(5), [&]() { return ran == 1 + static_cast<int>(priorityIndex(priority)); });
+        CHECK(done);
+    }
+
+    // retry() sessions at the default priority finish too
+    std::atomic<bool> finished{false};
+    scheduler.retry<int>(
+        1, constantDelay(std::chrono::microseconds(100)) + limitRetries(2),
+        [](RetryStatus, int) { return true; },
+        [](RetryStatus status) { return status.iteration_number; },
+        [&](int) {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished = true;
+            cv.notify_all();
+        });
+
+    std::unique_lock<std::mutex> lock(mutex);
+    CHECK(cv.wait_for(lock, std::chrono::seconds(5), [&]() { return finished.load(); }));
+}
+
+int main()
+{
+    reserveLimits();
+    schedulerWithSmallCapacity(1);
+    schedulerWithSmallCapacity(2);
+
+    return lt::retry::test::finish();
+}
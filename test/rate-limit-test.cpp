@@ -0,0 +1,83 @@
+#include "lt/retry/policies.h"
+#include "lt/retry/rate-limit.h"
+
+#include "check.h"
+
+#include <chrono>
+#include <memory>
+
+using namespace lt::retry;
+using namespace std::chrono_literals;
+
+static void windowCeiling()
+{
+    SlidingWindowRateLimiter limiter(3, 10s, 10);
+    auto now = SlidingWindowRateLimiter::clock::now();
+
+    CHECK(limiter.tryAcquire(now));
+    CHECK(limiter.tryAcquire(now));
+    CHECK(limiter.tryAcquire(now + 1s));
+    CHECK(!limiter.tryAcquire(now + 1s));
+    CHECK(limiter.inWindow(now + 1s) == 3);
+
+    // Once the first slice falls out of the window its two retries expire
+    CHECK(limiter.tryAcquire(now + 10s));
+    CHECK(limiter.tryAcquire(now + 10s));
+    CHECK(!limiter.tryAcquire(now + 10s));
+}
+
+static void reservedAhead()
+{
+    SlidingWindowRateLimiter limiter(2, 2s, 2);
+    auto now = SlidingWindowRateLimiter::clock::now();
+
+    CHECK(limiter.tryAcquire(now + 1s));
+    CHECK(limiter.tryAcquire(now + 1s));
+
+    // The current window has room, but the next one, which would also
+    // contain this retry, is already full
+    CHECK(limiter.inWindow(now) == 0);
+    CHECK(!limiter.tryAcquire(now));
+    CHECK(limiter.inWindow(now + 1s) == 2);
+}
+
+static void throttleStretchesIntoNextSlice()
+{
+    // One slice of a second, so the test runs well inside the first one
+    auto limiter = std::make_shared<SlidingWindowRateLimiter>(2, 1s, 1);
+    auto policy = throttleRetryRate(limiter, constantDelay(1ms));
+    RetryStatus status{};
+
+    CHECK(policy(status) == std::chrono::microseconds(1ms));
+    CHECK(policy(status) == std::chrono::microseconds(1ms));
+
+    auto stretched = policy(status);
+    CHECK(stretched && *stretched > 1ms && *stretched <= 1s);
+    CHECK(policy(status).has_value());
+
+    // Both the current slice and the next are full
+    CHECK(!policy(status));
+    CHECK(limiter->inWindow() == 2);
+}
+
+static void throttleGivesUpOnLongWindow()
+{
+    // The second slice still holds the first slice's retries, so stretching
+    // by one slice cannot help
+    auto limiter = std::make_shared<SlidingWindowRateLimiter>(1, 10s, 10);
+    auto policy = throttleRetryRate(limiter, constantDelay(1ms));
+    RetryStatus status{};
+
+    CHECK(policy(status).has_value());
+    CHECK(!policy(status));
+}
+
+int main()
+{
+    windowCeiling();
+    reservedAhead();
+    throttleStretchesIntoNextSlice();
+    throttleGivesUpOnLongWindow();
+
+    return lt::retry::test::finish();
+}
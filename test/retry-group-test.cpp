@@ -0,0 +1,124 @@
+#include "lt/retry/policies.h"
+#include "lt/retry/retry-group.h"
+
+#include "check.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace lt::retry;
+using namespace std::chrono;
+
+static auto always = [](PreemptibleRetryStatus, bool) { return true; };
+static auto succeeded = [](bool ok) { return ok; };
+
+// A success elsewhere in the group wakes a session out of a long backoff
+static void recoveryWakesSessions()
+{
+    RetryGroup group;
+    std::atomic<bool> recovered{false};
+    std::atomic<int> preempted{0};
+
+    auto start = steady_clock::now();
+
+    std::thread session([&]() {
+        group.retry<bool>(
+            constantDelay(seconds(10)) + limitRetries(5),
+            [](PreemptibleRetryStatus, bool ok) { return !ok; },
+            [&](PreemptibleRetryStatus status) {
+                if (status.condition_signalled) preempted += 1;
+                return recovered.load();
+            },
+            succeeded);
+    });
+
+    std::this_thread::sleep_for(milliseconds(50));
+    recovered = true;
+    group.notifySuccess();
+    session.join();
+
+    CHECK(preempted == 1);
+    CHECK(steady_clock::now() - start < seconds(5));
+}
+
+// Each decision consults the policy exactly once, so stateful policies are
+// not charged twice
+static void policyAppliedOncePerRetry()
+{
+    RetryGroup group;
+    int calls = 0;
+    auto counting = RetryPolicy([&](RetryStatus) -> std::optional<microseconds> {
+        calls += 1;
+        return microseconds(0);
+    });
+
+    int attempts = 0;
+    group.retry<bool>(
+        counting + limitRetries(3),
+        always,
+        [&](PreemptibleRetryStatus) {
+            attempts += 1;
+            return false;
+        },
+        succeeded);
+
+    CHECK(attempts == 4);
+    CHECK(calls == 4);
+}
+
+// Resets restart the policy's own limits, so only RetryGroupLimits stop a
+// session which keeps failing while the group recovers around it
+static void sessionLimitsSurviveResets()
+{
+    RetryGroup group;
+    std::atomic<bool> stop{false};
+
+    std::thread healthy([&]() {
+        while (!stop) {
+            group.notifySuccess();
+            std::this_thread::sleep_for(milliseconds(1));
+        }
+    });
+
+    int attempts = 0;
+    RetryGroupLimits limits;
+    limits.max_attempts = 20;
+
+    group.retry<bool>(
+        constantDelay(seconds(1)) + limitRetries(2),
+        always,
+        [&](PreemptibleRetryStatus) {
+            attempts += 1;
+            return false;
+        },
+        succeeded,
+        limits);
+
+    CHECK(attempts == 20);
+
+    limits = RetryGroupLimits{};
+    limits.max_elapsed = milliseconds(30);
+    auto start = steady_clock::now();
+
+    group.retry<bool>(
+        constantDelay(milliseconds(5)) + limitRetries(2),
+        always,
+        [](PreemptibleRetryStatus) { return false; },
+        succeeded,
+        limits);
+
+    CHECK(steady_clock::now() - start < milliseconds(500));
+
+    stop = true;
+    healthy.join();
+}
+
+int main()
+{
+    recoveryWakesSessions();
+    policyAppliedOncePerRetry();
+    sessionLimitsSurviveResets();
+
+    return lt::retry::test::finish();
+}
@@ -0,0 +1,190 @@
+#include "lt/retry/budget.h"
+#include "lt/retry/pending-pool.h"
+#include "lt/retry/scheduler.h"
+
+#include "check.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace lt::retry;
+using namespace std::chrono_literals;
+
+// Executor which queues dispatched tasks for the test to run one at a time
+struct ManualExecutor
+{
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::function<void()>> tasks;
+
+    RetryScheduler::Executor executor()
+    {
+        return [this](std::function<void()> task) {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+            cv.notify_all();
+        };
+    }
+
+    bool runOne()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        if (!cv.wait_for(lock, 5s, [this]() { return !tasks.empty(); })) {
+            return false;
+        }
+
+        auto task = std::move(tasks.front());
+        tasks.pop_front();
+        lock.unlock();
+
+        task();
+        return true;
+    }
+};
+
+struct CountingNode : RetryNode
+{
+    int fired = 0;
+
+    void fire() override { fired += 1; }
+};
+
+static void deficitRoundRobin()
+{
+    ManualExecutor manual;
+    std::string order;
+
+    {
+        RetryScheduler scheduler(manual.executor(), 1);
+        scheduler.configureTenant(1, {2});
+        scheduler.configureTenant(2, {1});
+
+        // A common delay makes them all due together, so the dispatch order
+        // is decided by the round robin alone
+        for (int i = 0; i < 6; i++) {
+            scheduler.schedule(1, 200ms, [&]() { order += 'A'; });
+        }
+        for (int i = 0; i < 3; i++) {
+            scheduler.schedule(2, 200ms, [&]() { order += 'B'; });
+        }
+
+        for (int i = 0; i < 9; i++) {
+            CHECK(manual.runOne());
+        }
+    }
+
+    CHECK(order == "AABAABAAB");
+}
+
+static void cancel()
+{
+    ManualExecutor manual;
+    CountingNode node;
+
+    {
+        RetryScheduler scheduler(manual.executor());
+
+        CHECK(scheduler.trySchedule(1, RetryPriority::Interactive, 10s, node) == RetryRejection::None);
+        CHECK(scheduler.pending(1) == 1);
+        CHECK(scheduler.cancel(node));
+        CHECK(scheduler.pending(1) == 0);
+        CHECK(!scheduler.cancel(node));
+
+        // A cancelled node can be scheduled again
+        CHECK(scheduler.trySchedule(1, RetryPriority::Interactive, 0ms, node) == RetryRejection::None);
+        CHECK(manual.runOne());
+    }
+
+    CHECK(node.fired == 1);
+}
+
+static void pendingLimits()
+{
+    ManualExecutor manual;
+    auto pool = std::make_shared<PendingRetryPool>(3);
+    RetryScheduler scheduler(manual.executor(), 16, {}, pool);
+
+    TenantConfig config;
+    config.max_pending = 2;
+    scheduler.configureTenant(1, config);
+
+    auto noop = []() {};
+
+    CHECK(scheduler.trySchedule(1, RetryPriority::Interactive, 10s, noop) == RetryRejection::None);
+    CHECK(scheduler.trySchedule(1, RetryPriority::Interactive, 10s, noop) == RetryRejection::None);
+    CHECK(scheduler.trySchedule(1, RetryPriority::Interactive, 10s, noop) == RetryRejection::TenantLimit);
+
+    CHECK(scheduler.trySchedule(2, RetryPriority::Interactive, 10s, noop) == RetryRejection::None);
+    CHECK(scheduler.trySchedule(2, RetryPriority::Interactive, 10s, noop) == RetryRejection::PoolCapacity);
+    CHECK(pool->pending() == 3);
+}
+
+static void tenantBudget()
+{
+    ManualExecutor manual;
+    auto pool = std::make_shared<PendingRetryPool>(100);
+    RetryScheduler scheduler(manual.executor(), 16, {}, pool);
+
+    TenantConfig config;
+    config.budget = std::make_shared<CostBudget>(2.0, 1.0, 1);
+    scheduler.configureTenant(1, config);
+
+    auto noop = []() {};
+
+    CHECK(scheduler.trySchedule(1, RetryPriority::Interactive, 10s, noop) == RetryRejection::None);
+    CHECK(scheduler.trySchedule(1, RetryPriority::Interactive, 10s, noop) == RetryRejection::None);
+    CHECK(scheduler.trySchedule(1, RetryPriority::Interactive, 10s, noop) == RetryRejection::TenantBudget);
+
+    // The refused retry does not hold a place in the pool, and other
+    // tenants are unaffected
+    CHECK(pool->pending() == 2);
+    CHECK(scheduler.trySchedule(2, RetryPriority::Interactive, 10s, noop) == RetryRejection::None);
+
+    config.budget->recordSuccess(1.0);
+    CHECK(scheduler.trySchedule(1, RetryPriority::Interactive, 10s, noop) == RetryRejection::None);
+}
+
+static void retrySession()
+{
+    ManualExecutor manual;
+    RetryScheduler scheduler(manual.executor());
+
+    TenantConfig config;
+    config.budget = std::make_shared<CostBudget>(1.0, 1.0, 1);
+    scheduler.configureTenant(1, config);
+
+    int attempts = 0;
+    RetryRejection rejection = RetryRejection::None;
+
+    scheduler.retry<bool>(
+        1, RetryPolicy([](RetryStatus) -> std::optional<std::chrono::microseconds> { return 0us; }),
+        [](RetryStatus, bool ok) { return !ok; },
+        [&](RetryStatus) {
+            attempts += 1;
+            return false;
+        },
+        [&](bool) { rejection = lastRetryRejection(); });
+
+    // The first attempt runs inline, the budget covers one retry
+    CHECK(manual.runOne());
+    CHECK(attempts == 2);
+    CHECK(rejection == RetryRejection::TenantBudget);
+}
+
+int main()
+{
+    deficitRoundRobin();
+    cancel();
+    pendingLimits();
+    tenantBudget();
+    retrySession();
+
+    return lt::retry::test::finish();
+}